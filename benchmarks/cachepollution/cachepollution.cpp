@@ -0,0 +1,169 @@
+///-*-C++-*-//////////////////////////////////////////////////////////////////
+//
+// Hoard: A Fast, Scalable, and Memory-Efficient Allocator
+//        for Shared-Memory Multiprocessors
+// Contact author: Emery Berger, http://www.cs.umass.edu/~emery
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as
+// published by the Free Software Foundation, http://www.fsf.org.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file cachepollution.cpp
+ *
+ * cachepollution measures how much a thread that allocates big blocks
+ * slows down the threads around it by evicting their data from the
+ * caches. A reader thread scans a working set small enough to stay in
+ * the cache, over and over, and times each pass. Meanwhile a writer
+ * thread callocs big blocks, grows each to twice its size with
+ * realloc, and frees it: either with plain calloc and realloc
+ * ("plain"), or, when the allocator provides them, with hoard_calloc
+ * and hoard_realloc ("streaming"), which clear and copy big blocks
+ * with stores that go around the caches. It reports the reader's
+ * average time per pass, alone and beside the writer, and the
+ * writer's time per block.
+ *
+ * Try the following:
+ *
+ *  cachepollution 1024 16 100 plain
+ *  cachepollution 1024 16 100 streaming
+ *
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timer.h"
+
+typedef void * (*callocFunction) (size_t, size_t);
+typedef void * (*reallocFunction) (void *, size_t);
+
+static callocFunction theCalloc = calloc;
+static reallocFunction theRealloc = realloc;
+
+static size_t workingSetSize;
+static size_t blockSize;
+static int rounds;
+
+static volatile bool writing;
+static volatile bool reading;
+static volatile long sink;
+
+/// Read every cache line of the working set once, returning the time taken.
+static double scan (const char * ws)
+{
+  HL::Timer t;
+  t.start();
+  long sum = 0;
+  for (size_t i = 0; i < workingSetSize; i += 64) {
+    sum += ws[i];
+  }
+  t.stop();
+  sink = sink + sum;
+  return (double) t;
+}
+
+struct ReaderResult {
+  double time;
+  long passes;
+};
+
+static void * reader (void * arg)
+{
+  ReaderResult * result = (ReaderResult *) arg;
+  char * ws = (char *) malloc (workingSetSize);
+  memset (ws, 1, workingSetSize);
+  result->time = 0;
+  result->passes = 0;
+  reading = true;
+  while (writing) {
+    result->time += scan (ws);
+    result->passes++;
+  }
+  free (ws);
+  return NULL;
+}
+
+static double writer (void)
+{
+  HL::Timer t;
+  t.start();
+  for (int r = 0; r < rounds; r++) {
+    char * block = (char *) theCalloc (1, blockSize);
+    // Write to every page, as a program filling in a table would.
+    for (size_t i = 0; i < blockSize; i += 4096) {
+      block[i] = (char) r;
+    }
+    block = (char *) theRealloc (block, 2 * blockSize);
+    sink = sink + block[0] + block[blockSize - 4096];
+    free (block);
+  }
+  t.stop();
+  return (double) t;
+}
+
+int main (int argc, char * argv[])
+{
+  if (argc < 5) {
+    fprintf (stderr, "Usage: %s working-set-KB block-MB rounds plain|streaming\n", argv[0]);
+    return 1;
+  }
+  workingSetSize = (size_t) atoi (argv[1]) * 1024;
+  blockSize = (size_t) atoi (argv[2]) * 1024 * 1024;
+  rounds = atoi (argv[3]);
+  if ((workingSetSize == 0) || (blockSize == 0) || (rounds < 1)) {
+    fprintf (stderr, "Usage: %s working-set-KB block-MB rounds plain|streaming\n", argv[0]);
+    return 1;
+  }
+
+  if (strcmp (argv[4], "streaming") == 0) {
+    callocFunction c = (callocFunction) dlsym (RTLD_DEFAULT, "hoard_calloc");
+    reallocFunction r = (reallocFunction) dlsym (RTLD_DEFAULT, "hoard_realloc");
+    if (c && r) {
+      theCalloc = c;
+      theRealloc = r;
+    } else {
+      fprintf (stderr, "hoard_calloc not found: using calloc and realloc.\n");
+    }
+  }
+
+  // The reader alone, for comparison.
+  char * ws = (char *) malloc (workingSetSize);
+  memset (ws, 1, workingSetSize);
+  double alone = 0;
+  const int alonePasses = 1000;
+  for (int i = 0; i < alonePasses; i++) {
+    alone += scan (ws);
+  }
+  free (ws);
+
+  ReaderResult result;
+  writing = true;
+  pthread_t t;
+  pthread_create (&t, NULL, reader, &result);
+  while (!reading) {
+    sched_yield();
+  }
+  const double writeTime = writer();
+  writing = false;
+  pthread_join (t, NULL);
+
+  printf ("Reader alone: %f us per pass.\n", 1e6 * alone / alonePasses);
+  if (result.passes > 0) {
+    printf ("Reader beside writer: %f us per pass.\n", 1e6 * result.time / result.passes);
+  }
+  printf ("Writer: %f ms per block.\n", 1e3 * writeTime / rounds);
+
+  return 0;
+}
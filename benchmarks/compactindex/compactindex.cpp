@@ -0,0 +1,303 @@
+///-*-C++-*-//////////////////////////////////////////////////////////////////
+//
+// Hoard: A Fast, Scalable, and Memory-Efficient Allocator
+//        for Shared-Memory Multiprocessors
+// Contact author: Emery Berger, http://www.cs.umass.edu/~emery
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as
+// published by the Free Software Foundation, http://www.fsf.org.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file compactindex.cpp
+ *
+ * compactindex builds an in-memory index (a binary search tree of
+ * random keys) and looks every key up. In "pointers" mode, nodes link
+ * to their children with pointers, and come from malloc; in "offsets"
+ * mode, when the allocator provides hoard_arena_create_compact, they
+ * come from a compact arena and link with 32-bit offsets from its
+ * window's base, which makes each node half the size. It reports the
+ * time to build and search the index, and the memory it takes per
+ * node (from the growth of the resident set while it is built).
+ *
+ * Try the following:
+ *
+ *  compactindex 1 2000000 pointers
+ *  compactindex 1 2000000 offsets
+ *  compactindex P 2000000 offsets
+ *
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timer.h"
+
+struct hoard_arena;
+
+typedef struct hoard_arena * (*arenaCreateFunction) (void);
+typedef void * (*arenaMallocFunction) (struct hoard_arena *, size_t);
+typedef void (*arenaDestroyFunction) (struct hoard_arena *);
+typedef void * (*compactBaseFunction) (void);
+
+static arenaCreateFunction arenaCreate;
+static arenaMallocFunction arenaMalloc;
+static arenaDestroyFunction arenaDestroy;
+
+/// The compact arenas' window (see hoard_compact_base).
+static char * base;
+
+static int keys;
+static bool useOffsets;
+
+/// Lines the threads up so that one can measure the whole index.
+static pthread_barrier_t barrier;
+
+/// The resident set before and after the threads build their indexes.
+static size_t residentBefore;
+static size_t residentAfter;
+
+// A node that links with pointers: 24 bytes.
+
+struct Node {
+  unsigned int key;
+  Node * left;
+  Node * right;
+};
+
+// A node that links with offsets from base: 12 bytes.
+
+struct CompactNode {
+  unsigned int key;
+  unsigned int left;
+  unsigned int right;
+};
+
+static inline CompactNode * decode (unsigned int offset) {
+  return offset ? (CompactNode *) (base + offset) : NULL;
+}
+
+static inline unsigned int encode (CompactNode * n) {
+  return n ? (unsigned int) ((char *) n - base) : 0;
+}
+
+static Node * insert (Node * root, unsigned int key)
+{
+  Node * n = (Node *) malloc (sizeof(Node));
+  n->key = key;
+  n->left = n->right = NULL;
+  if (root == NULL) {
+    return n;
+  }
+  Node * p = root;
+  for (;;) {
+    Node ** next = (key < p->key) ? &p->left : &p->right;
+    if (*next == NULL) {
+      *next = n;
+      return root;
+    }
+    p = *next;
+  }
+}
+
+static bool find (Node * n, unsigned int key)
+{
+  while (n) {
+    if (key == n->key) {
+      return true;
+    }
+    n = (key < n->key) ? n->left : n->right;
+  }
+  return false;
+}
+
+static void release (Node * n)
+{
+  while (n) {
+    release (n->left);
+    Node * right = n->right;
+    free (n);
+    n = right;
+  }
+}
+
+static CompactNode * insert (struct hoard_arena * arena, CompactNode * root, unsigned int key)
+{
+  CompactNode * n = (CompactNode *) arenaMalloc (arena, sizeof(CompactNode));
+  n->key = key;
+  n->left = n->right = 0;
+  if (root == NULL) {
+    return n;
+  }
+  CompactNode * p = root;
+  for (;;) {
+    unsigned int * next = (key < p->key) ? &p->left : &p->right;
+    if (*next == 0) {
+      *next = encode (n);
+      return root;
+    }
+    p = decode (*next);
+  }
+}
+
+static bool find (CompactNode * n, unsigned int key)
+{
+  while (n) {
+    if (key == n->key) {
+      return true;
+    }
+    n = decode ((key < n->key) ? n->left : n->right);
+  }
+  return false;
+}
+
+/// The resident set, in bytes.
+static size_t resident (void)
+{
+  size_t pages = 0, rss = 0;
+  FILE * f = fopen ("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf (f, "%lu %lu", &pages, &rss) != 2) {
+      rss = 0;
+    }
+    fclose (f);
+  }
+  return rss * (size_t) sysconf (_SC_PAGESIZE);
+}
+
+struct Result {
+  int id;
+  double build;
+  double search;
+  long found;
+};
+
+/// Have one thread record the resident set once all get here.
+static void measure (Result * result, size_t& where)
+{
+  pthread_barrier_wait (&barrier);
+  if (result->id == 0) {
+    where = resident();
+  }
+  pthread_barrier_wait (&barrier);
+}
+
+static void * worker (void * arg)
+{
+  Result * result = (Result *) arg;
+  unsigned int seed = (unsigned int) result->id + 1;
+  unsigned int * k = new unsigned int[keys];
+  for (int i = 0; i < keys; i++) {
+    k[i] = (unsigned int) rand_r (&seed);
+  }
+  result->found = 0;
+  measure (result, residentBefore);
+
+  HL::Timer build, search;
+  if (useOffsets) {
+    struct hoard_arena * arena = arenaCreate();
+    CompactNode * root = NULL;
+    build.start();
+    for (int i = 0; i < keys; i++) {
+      root = insert (arena, root, k[i]);
+    }
+    build.stop();
+    measure (result, residentAfter);
+    search.start();
+    for (int i = 0; i < keys; i++) {
+      result->found += find (root, k[i]);
+    }
+    search.stop();
+    arenaDestroy (arena);
+  } else {
+    Node * root = NULL;
+    build.start();
+    for (int i = 0; i < keys; i++) {
+      root = insert (root, k[i]);
+    }
+    build.stop();
+    measure (result, residentAfter);
+    search.start();
+    for (int i = 0; i < keys; i++) {
+      result->found += find (root, k[i]);
+    }
+    search.stop();
+    release (root);
+  }
+  result->build = (double) build;
+  result->search = (double) search;
+  delete [] k;
+  return NULL;
+}
+
+int main (int argc, char * argv[])
+{
+  if (argc < 4) {
+    fprintf (stderr, "Usage: %s threads keys pointers|offsets\n", argv[0]);
+    return 1;
+  }
+  const int nthreads = atoi (argv[1]);
+  keys = atoi (argv[2]);
+  useOffsets = (strcmp (argv[3], "offsets") == 0);
+  if ((nthreads < 1) || (keys < 1)) {
+    fprintf (stderr, "Usage: %s threads keys pointers|offsets\n", argv[0]);
+    return 1;
+  }
+
+  if (useOffsets) {
+    arenaCreate = (arenaCreateFunction) dlsym (RTLD_DEFAULT, "hoard_arena_create_compact");
+    arenaMalloc = (arenaMallocFunction) dlsym (RTLD_DEFAULT, "hoard_arena_malloc");
+    arenaDestroy = (arenaDestroyFunction) dlsym (RTLD_DEFAULT, "hoard_arena_destroy");
+    compactBaseFunction compactBase = (compactBaseFunction) dlsym (RTLD_DEFAULT, "hoard_compact_base");
+    if (!arenaCreate || !arenaMalloc || !arenaDestroy || !compactBase) {
+      fprintf (stderr, "hoard_arena_create_compact not found: using pointers.\n");
+      useOffsets = false;
+    } else {
+      base = (char *) compactBase();
+    }
+  }
+
+  pthread_t * threads = new pthread_t[nthreads];
+  Result * results = new Result[nthreads];
+
+  pthread_barrier_init (&barrier, NULL, nthreads);
+
+  HL::Timer t;
+  t.start();
+
+  for (int i = 0; i < nthreads; i++) {
+    results[i].id = i;
+    pthread_create (&threads[i], NULL, worker, &results[i]);
+  }
+  double build = 0, search = 0;
+  long found = 0;
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join (threads[i], NULL);
+    build += results[i].build;
+    search += results[i].search;
+    found += results[i].found;
+  }
+
+  t.stop();
+
+  printf ("Time elapsed = %f seconds (%ld of %ld keys found).\n", (double) t, found, (long) nthreads * keys);
+  printf ("Build: %f seconds; search: %f seconds.\n", build / nthreads, search / nthreads);
+  printf ("Memory: %f bytes per node.\n", (double) (residentAfter - residentBefore) / ((double) nthreads * keys));
+
+  pthread_barrier_destroy (&barrier);
+  delete [] threads;
+  delete [] results;
+
+  return 0;
+}
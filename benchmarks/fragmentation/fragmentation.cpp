@@ -0,0 +1,136 @@
+///-*-C++-*-//////////////////////////////////////////////////////////////////
+//
+// Hoard: A Fast, Scalable, and Memory-Efficient Allocator
+//        for Shared-Memory Multiprocessors
+// Contact author: Emery Berger, http://www.cs.umass.edu/~emery
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as
+// published by the Free Software Foundation, http://www.fsf.org.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file fragmentation.cpp
+ *
+ * fragmentation models a long-running server that leaves a few
+ * survivors scattered across its heap: each round allocates a batch
+ * of objects and then frees all but a random fraction of them.
+ * It reports the resident set size (RSS) after every round. An
+ * allocator that cannot move objects ends up with many sparse
+ * superblocks; one that meshes them (Hoard built with HOARD_MESH)
+ * should hold far less memory.
+ *
+ * Allocators that compact on a background thread (Hoard meshes on its
+ * maintenance thread) need time between rounds: the optional last
+ * argument pauses that many milliseconds after each round, untimed,
+ * having first started and joined one thread, which is what starts
+ * Hoard's maintenance thread.
+ *
+ * Try the following:
+ *
+ *  fragmentation 64 200000 2 20
+ *  fragmentation 64 200000 2 20 250
+ *
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timer.h"
+
+// Return the resident set size in kilobytes (Linux only; 0 elsewhere).
+static long residentKB (void)
+{
+  long size = 0, resident = 0;
+  FILE * f = fopen ("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf (f, "%ld %ld", &size, &resident) != 2) {
+      resident = 0;
+    }
+    fclose (f);
+  }
+  return resident * 4;
+}
+
+static void * nothing (void * arg)
+{
+  return arg;
+}
+
+int main (int argc, char * argv[])
+{
+  int objSize;
+  int objects;
+  int survivorPercent;
+  int rounds;
+  int pauseMs = 0;
+
+  if (argc > 4) {
+    objSize = atoi(argv[1]);
+    objects = atoi(argv[2]);
+    survivorPercent = atoi(argv[3]);
+    rounds = atoi(argv[4]);
+    if (argc > 5) {
+      pauseMs = atoi(argv[5]);
+    }
+  } else {
+    fprintf (stderr, "Usage: %s objSize objects survivor-percent rounds [pause-ms]\n", argv[0]);
+    return 1;
+  }
+
+  if (pauseMs > 0) {
+    pthread_t thread;
+    pthread_create (&thread, NULL, nothing, NULL);
+    pthread_join (thread, NULL);
+  }
+
+  // Everything that survives stays live until the end.
+  char ** survivors = new char * [(long) objects * rounds];
+  long live = 0;
+  char ** batch = new char * [objects];
+
+  srand (1);
+
+  HL::Timer t;
+  double elapsed = 0;
+
+  for (int r = 0; r < rounds; r++) {
+    t.start();
+    for (int i = 0; i < objects; i++) {
+      batch[i] = new char[objSize];
+      memset (batch[i], r, objSize);
+    }
+    for (int i = 0; i < objects; i++) {
+      if (rand() % 100 < survivorPercent) {
+	survivors[live++] = batch[i];
+      } else {
+	delete [] batch[i];
+      }
+    }
+    t.stop();
+    elapsed += (double) t;
+    if (pauseMs > 0) {
+      usleep (pauseMs * 1000);
+    }
+    printf ("round %d: %ld live objects (%ld KB), RSS = %ld KB\n",
+	    r, live, (live * objSize) / 1024, residentKB());
+  }
+
+  for (long i = 0; i < live; i++) {
+    delete [] survivors[i];
+  }
+  delete [] survivors;
+  delete [] batch;
+
+  printf ("Time elapsed = %f seconds.\n", elapsed);
+  return 0;
+}
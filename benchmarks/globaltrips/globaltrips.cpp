@@ -0,0 +1,129 @@
+///-*-C++-*-//////////////////////////////////////////////////////////////////
+//
+// Hoard: A Fast, Scalable, and Memory-Efficient Allocator
+//        for Shared-Memory Multiprocessors
+// Contact author: Emery Berger, http://www.cs.umass.edu/~emery
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as
+// published by the Free Software Foundation, http://www.fsf.org.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file globaltrips.cpp
+ *
+ * globaltrips allocates in bursts: each thread repeatedly allocates
+ * a burst of objects of one size, more than its heap holds, and then
+ * frees them all, so superblocks keep moving between the thread's
+ * heap and the global heap. It reports the time taken and, when the
+ * allocator provides hoard_get_stats, how many times the threads
+ * locked the global heap to move superblocks, per million
+ * allocations.
+ *
+ * Try the following:
+ *
+ *  globaltrips 1 20000 100 512
+ *  globaltrips P 20000 100 512
+ *
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "timer.h"
+
+// The start of Hoard's struct hoard_stats (see hoard.h).
+struct hoard_stats {
+  size_t heap_bytes;
+  size_t heap_in_use_bytes;
+  size_t global_bytes;
+  size_t global_in_use_bytes;
+  size_t global_heap_trips;
+  size_t released_superblocks;
+  size_t maintenance_passes;
+  int memory_pressure;
+};
+
+typedef void (*statsFunction) (struct hoard_stats *);
+
+static int objects;
+static int rounds;
+static size_t objectSize;
+
+static void * worker (void *)
+{
+  void ** burst = (void **) malloc (objects * sizeof(void *));
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < objects; i++) {
+      burst[i] = malloc (objectSize);
+      *((char *) burst[i]) = (char) i;
+    }
+    for (int i = 0; i < objects; i++) {
+      free (burst[i]);
+    }
+  }
+  free (burst);
+  return NULL;
+}
+
+static size_t trips (statsFunction getStats)
+{
+  struct hoard_stats stats;
+  if (!getStats) {
+    return 0;
+  }
+  getStats (&stats);
+  return stats.global_heap_trips;
+}
+
+int main (int argc, char * argv[])
+{
+  if (argc < 5) {
+    fprintf (stderr, "Usage: %s threads objects rounds object-size\n", argv[0]);
+    return 1;
+  }
+  const int nthreads = atoi (argv[1]);
+  objects = atoi (argv[2]);
+  rounds = atoi (argv[3]);
+  objectSize = (size_t) atol (argv[4]);
+  if ((nthreads < 1) || (objects < 1) || (rounds < 1) || (objectSize < 1)) {
+    fprintf (stderr, "Usage: %s threads objects rounds object-size\n", argv[0]);
+    return 1;
+  }
+
+  statsFunction getStats = (statsFunction) dlsym (RTLD_DEFAULT, "hoard_get_stats");
+  pthread_t * threads = new pthread_t[nthreads];
+
+  const size_t before = trips (getStats);
+  HL::Timer t;
+  t.start();
+
+  for (int i = 0; i < nthreads; i++) {
+    pthread_create (&threads[i], NULL, worker, NULL);
+  }
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join (threads[i], NULL);
+  }
+
+  t.stop();
+  const size_t after = trips (getStats);
+
+  const double allocations = (double) nthreads * objects * rounds;
+  printf ("Time elapsed = %f seconds.\n", (double) t);
+  if (getStats) {
+    printf ("Global heap trips = %lu (%.1f per million allocations).\n",
+	    (unsigned long) (after - before), 1e6 * (after - before) / allocations);
+  } else {
+    printf ("hoard_get_stats not found: global heap trips not reported.\n");
+  }
+  delete [] threads;
+  return 0;
+}
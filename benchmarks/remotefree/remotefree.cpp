@@ -0,0 +1,150 @@
+///-*-C++-*-//////////////////////////////////////////////////////////////////
+//
+// Hoard: A Fast, Scalable, and Memory-Efficient Allocator
+//        for Shared-Memory Multiprocessors
+// Contact author: Emery Berger, http://www.cs.umass.edu/~emery
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as
+// published by the Free Software Foundation, http://www.fsf.org.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file remotefree.cpp
+ *
+ * remotefree measures the cost of freeing objects that another
+ * thread allocated. Each pair of threads passes batches of objects
+ * one way: the producer allocates a batch, the consumer frees it, and
+ * only the consumer's time in free counts. Every free then has to
+ * reach the heap that owns the object, so the per-free time reflects
+ * how cheaply the allocator dispatches to that heap (and locks it).
+ *
+ * Try the following:
+ *
+ *  remotefree 1 10000 1000 64
+ *  remotefree P 10000 1000 64
+ *
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "timer.h"
+
+static int objects;
+static int rounds;
+static int objectSize;
+
+// A producer and a consumer, which hand one batch back and forth.
+struct pair {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  bool full;		// true while the batch awaits the consumer.
+  void ** batch;
+  double freeSeconds;	// the consumer's time in free.
+};
+
+static void * producer (void * arg)
+{
+  pair * p = (pair *) arg;
+  for (int r = 0; r < rounds; r++) {
+    pthread_mutex_lock (&p->lock);
+    while (p->full) {
+      pthread_cond_wait (&p->changed, &p->lock);
+    }
+    pthread_mutex_unlock (&p->lock);
+    for (int i = 0; i < objects; i++) {
+      p->batch[i] = malloc (objectSize);
+      // Touch it, as a real producer would.
+      *((char *) p->batch[i]) = (char) i;
+    }
+    pthread_mutex_lock (&p->lock);
+    p->full = true;
+    pthread_cond_signal (&p->changed);
+    pthread_mutex_unlock (&p->lock);
+  }
+  return NULL;
+}
+
+static void * consumer (void * arg)
+{
+  pair * p = (pair *) arg;
+  double seconds = 0.0;
+  for (int r = 0; r < rounds; r++) {
+    pthread_mutex_lock (&p->lock);
+    while (!p->full) {
+      pthread_cond_wait (&p->changed, &p->lock);
+    }
+    pthread_mutex_unlock (&p->lock);
+    HL::Timer t;
+    t.start();
+    for (int i = 0; i < objects; i++) {
+      free (p->batch[i]);
+    }
+    t.stop();
+    seconds += (double) t;
+    pthread_mutex_lock (&p->lock);
+    p->full = false;
+    pthread_cond_signal (&p->changed);
+    pthread_mutex_unlock (&p->lock);
+  }
+  p->freeSeconds = seconds;
+  return NULL;
+}
+
+int main (int argc, char * argv[])
+{
+  if (argc < 5) {
+    fprintf (stderr, "Usage: %s pairs objects rounds object-size\n", argv[0]);
+    return 1;
+  }
+  const int pairs = atoi (argv[1]);
+  objects = atoi (argv[2]);
+  rounds = atoi (argv[3]);
+  objectSize = atoi (argv[4]);
+  if ((pairs < 1) || (objects < 1) || (rounds < 1) || (objectSize < 1)) {
+    fprintf (stderr, "Usage: %s pairs objects rounds object-size\n", argv[0]);
+    return 1;
+  }
+
+  pair * p = new pair[pairs];
+  pthread_t * threads = new pthread_t[2 * pairs];
+
+  HL::Timer t;
+  t.start();
+
+  for (int i = 0; i < pairs; i++) {
+    pthread_mutex_init (&p[i].lock, NULL);
+    pthread_cond_init (&p[i].changed, NULL);
+    p[i].full = false;
+    p[i].batch = new void *[objects];
+    p[i].freeSeconds = 0.0;
+    pthread_create (&threads[2*i], NULL, producer, &p[i]);
+    pthread_create (&threads[2*i+1], NULL, consumer, &p[i]);
+  }
+  double freeSeconds = 0.0;
+  for (int i = 0; i < pairs; i++) {
+    pthread_join (threads[2*i], NULL);
+    pthread_join (threads[2*i+1], NULL);
+    freeSeconds += p[i].freeSeconds;
+    delete [] p[i].batch;
+  }
+
+  t.stop();
+
+  const double frees = (double) pairs * objects * rounds;
+  printf ("Time elapsed = %f seconds.\n", (double) t);
+  printf ("Remote free = %.1f ns each (%.0f frees).\n",
+	  1e9 * freeSeconds / frees, frees);
+
+  delete [] threads;
+  delete [] p;
+  return 0;
+}
@@ -0,0 +1,207 @@
+///-*-C++-*-//////////////////////////////////////////////////////////////////
+//
+// Hoard: A Fast, Scalable, and Memory-Efficient Allocator
+//        for Shared-Memory Multiprocessors
+// Contact author: Emery Berger, http://www.cs.umass.edu/~emery
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as
+// published by the Free Software Foundation, http://www.fsf.org.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file requestarena.cpp
+ *
+ * requestarena models a server: each thread handles requests, each of
+ * which builds a tree of nodes and strings with plain new and strdup
+ * (as a parser in a library would), reads it, and throws it away. In
+ * "free" mode, the request frees every object; in "arena" mode, the
+ * request runs inside an arena (see hoard_arena_push), and teardown
+ * destroys the arena instead. It reports the time taken, and the part
+ * of it spent tearing requests down.
+ *
+ * Try the following:
+ *
+ *  requestarena 1 2000 5000 free
+ *  requestarena 1 2000 5000 arena
+ *  requestarena P 2000 5000 arena
+ *
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timer.h"
+
+struct hoard_arena;
+
+typedef struct hoard_arena * (*arenaCreateFunction) (void);
+typedef int (*arenaPushFunction) (struct hoard_arena *);
+typedef void (*arenaPopFunction) (void);
+typedef void (*arenaDestroyFunction) (struct hoard_arena *);
+
+static arenaCreateFunction arenaCreate;
+static arenaPushFunction arenaPush;
+static arenaPopFunction arenaPop;
+static arenaDestroyFunction arenaDestroy;
+
+static int requests;
+static int nodesPerRequest;
+static bool useArenas;
+
+// The library's view of a request: it knows nothing of arenas.
+
+class Node {
+public:
+  Node (Node * parent, int i)
+    : next (parent ? parent->child : NULL),
+      child (NULL),
+      value (i)
+  {
+    char buf[64];
+    sprintf (buf, "node-%d", i);
+    name = strdup (buf);
+  }
+
+  ~Node (void) {
+    free (name);
+  }
+
+  Node * next;
+  Node * child;
+  char * name;
+  int value;
+};
+
+static Node * parse (int nodes)
+{
+  Node * root = new Node (NULL, 0);
+  Node * parent = root;
+  for (int i = 1; i < nodes; i++) {
+    Node * n = new Node (parent, i);
+    parent->child = n;
+    // Every eighth node starts a new level.
+    if (i % 8 == 0) {
+      parent = n;
+    }
+  }
+  return root;
+}
+
+static long visit (Node * n)
+{
+  long sum = 0;
+  while (n) {
+    sum += n->value + n->name[0];
+    sum += visit (n->child);
+    n = n->next;
+  }
+  return sum;
+}
+
+static void release (Node * n)
+{
+  while (n) {
+    Node * next = n->next;
+    release (n->child);
+    delete n;
+    n = next;
+  }
+}
+
+struct Result {
+  double teardown;
+  long checksum;
+};
+
+static void * worker (void * arg)
+{
+  Result * result = (Result *) arg;
+  result->teardown = 0;
+  result->checksum = 0;
+  for (int r = 0; r < requests; r++) {
+    struct hoard_arena * arena = NULL;
+    if (useArenas) {
+      arena = arenaCreate();
+      arenaPush (arena);
+    }
+    Node * root = parse (nodesPerRequest);
+    result->checksum += visit (root);
+    if (useArenas) {
+      arenaPop();
+    }
+    HL::Timer t;
+    t.start();
+    if (useArenas) {
+      arenaDestroy (arena);
+    } else {
+      release (root);
+    }
+    t.stop();
+    result->teardown += (double) t;
+  }
+  return NULL;
+}
+
+int main (int argc, char * argv[])
+{
+  if (argc < 5) {
+    fprintf (stderr, "Usage: %s threads requests nodes-per-request free|arena\n", argv[0]);
+    return 1;
+  }
+  const int nthreads = atoi (argv[1]);
+  requests = atoi (argv[2]);
+  nodesPerRequest = atoi (argv[3]);
+  useArenas = (strcmp (argv[4], "arena") == 0);
+  if ((nthreads < 1) || (requests < 1) || (nodesPerRequest < 1)) {
+    fprintf (stderr, "Usage: %s threads requests nodes-per-request free|arena\n", argv[0]);
+    return 1;
+  }
+
+  if (useArenas) {
+    arenaCreate = (arenaCreateFunction) dlsym (RTLD_DEFAULT, "hoard_arena_create");
+    arenaPush = (arenaPushFunction) dlsym (RTLD_DEFAULT, "hoard_arena_push");
+    arenaPop = (arenaPopFunction) dlsym (RTLD_DEFAULT, "hoard_arena_pop");
+    arenaDestroy = (arenaDestroyFunction) dlsym (RTLD_DEFAULT, "hoard_arena_destroy");
+    if (!arenaCreate || !arenaPush || !arenaPop || !arenaDestroy) {
+      fprintf (stderr, "hoard_arena_create not found: freeing objects one by one.\n");
+      useArenas = false;
+    }
+  }
+
+  pthread_t * threads = new pthread_t[nthreads];
+  Result * results = new Result[nthreads];
+
+  HL::Timer t;
+  t.start();
+
+  for (int i = 0; i < nthreads; i++) {
+    pthread_create (&threads[i], NULL, worker, &results[i]);
+  }
+  double teardown = 0;
+  long checksum = 0;
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join (threads[i], NULL);
+    teardown += results[i].teardown;
+    checksum += results[i].checksum;
+  }
+
+  t.stop();
+
+  printf ("Time elapsed = %f seconds (checksum %ld).\n", (double) t, checksum);
+  printf ("Teardown (%s) = %f seconds, %f microseconds per request.\n",
+	  useArenas ? "arena" : "free", teardown / nthreads,
+	  1e6 * teardown / ((double) nthreads * requests));
+  delete [] threads;
+  delete [] results;
+  return 0;
+}
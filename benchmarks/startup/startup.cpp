@@ -0,0 +1,110 @@
+///-*-C++-*-//////////////////////////////////////////////////////////////////
+//
+// Hoard: A Fast, Scalable, and Memory-Efficient Allocator
+//        for Shared-Memory Multiprocessors
+// Contact author: Emery Berger, http://www.cs.umass.edu/~emery
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as
+// published by the Free Software Foundation, http://www.fsf.org.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file startup.cpp
+ *
+ * startup measures what an allocator costs a short-lived,
+ * single-threaded tool (think /bin/true run under LD_PRELOAD). It
+ * runs itself repeatedly as a child that allocates and frees one
+ * object and exits, then reports the average time per run and the
+ * resident set size (RSS) of the child.
+ *
+ * Try the following:
+ *
+ *  startup 1000
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "timer.h"
+
+// Return the resident set size in kilobytes (Linux only; 0 elsewhere).
+static long residentKB (void)
+{
+  long size = 0, resident = 0;
+  FILE * f = fopen ("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf (f, "%ld %ld", &size, &resident) != 2) {
+      resident = 0;
+    }
+    fclose (f);
+  }
+  return resident * 4;
+}
+
+// The child: one allocation, then exit with the RSS on stdout.
+static int child (bool report)
+{
+  volatile char * ptr = new char[16];
+  ptr[0] = 'x';
+  delete [] ptr;
+  if (report) {
+    printf ("RSS = %ld KB\n", residentKB());
+  }
+  return 0;
+}
+
+static void runChild (char * self, const char * mode)
+{
+  pid_t pid = fork();
+  if (pid == 0) {
+    char * args[] = { self, (char *) mode, NULL };
+    execv (self, args);
+    _exit (1);
+  }
+  int status;
+  waitpid (pid, &status, 0);
+}
+
+int main (int argc, char * argv[])
+{
+  int runs;
+
+  if (argc > 1) {
+    if (strcmp (argv[1], "-child") == 0) {
+      return child (false);
+    }
+    if (strcmp (argv[1], "-report") == 0) {
+      return child (true);
+    }
+    runs = atoi(argv[1]);
+  } else {
+    fprintf (stderr, "Usage: %s runs\n", argv[0]);
+    return 1;
+  }
+
+  fflush (stdout);
+  runChild (argv[0], "-report");
+
+  HL::Timer t;
+  t.start();
+
+  for (int i = 0; i < runs; i++) {
+    runChild (argv[0], "-child");
+  }
+
+  t.stop();
+
+  printf ("Time per run = %f milliseconds.\n", 1000.0 * (double) t / runs);
+  return 0;
+}
@@ -0,0 +1,128 @@
+///-*-C++-*-//////////////////////////////////////////////////////////////////
+//
+// Hoard: A Fast, Scalable, and Memory-Efficient Allocator
+//        for Shared-Memory Multiprocessors
+// Contact author: Emery Berger, http://www.cs.umass.edu/~emery
+//
+// This library is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Library General Public License as
+// published by the Free Software Foundation, http://www.fsf.org.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file tinyobjects.cpp
+ *
+ * tinyobjects models a symbol table built from 8-byte nodes: it
+ * allocates the given number of nodes, frees every other one and
+ * allocates them again, and reports the time taken and the growth
+ * in resident set size (Linux only). With "small" as the last
+ * argument, nodes come from hoard_malloc_small when the allocator
+ * provides it, rather than from malloc.
+ *
+ * Try the following:
+ *
+ *  tinyobjects 10000000
+ *  tinyobjects 10000000 small
+ *
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "timer.h"
+
+// A symbol table node: a symbol number and the index of the next node.
+struct node {
+  int symbol;
+  int next;
+};
+
+typedef void * (*mallocFunction) (size_t);
+
+// Return the resident set size in kilobytes (Linux only; 0 elsewhere).
+static long residentKB (void)
+{
+  long size = 0, resident = 0;
+  FILE * f = fopen ("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf (f, "%ld %ld", &size, &resident) != 2) {
+      resident = 0;
+    }
+    fclose (f);
+  }
+  return resident * 4;
+}
+
+int main (int argc, char * argv[])
+{
+  int nodes;
+  mallocFunction allocate = malloc;
+
+  if (argc > 1) {
+    nodes = atoi(argv[1]);
+  } else {
+    fprintf (stderr, "Usage: %s nodes [small]\n", argv[0]);
+    return 1;
+  }
+
+  if ((argc > 2) && (strcmp (argv[2], "small") == 0)) {
+    allocate = (mallocFunction) dlsym (RTLD_DEFAULT, "hoard_malloc_small");
+    if (allocate == NULL) {
+      fprintf (stderr, "hoard_malloc_small not found: using malloc.\n");
+      allocate = malloc;
+    }
+  }
+
+  // The table itself is mapped directly, so that only the nodes
+  // count against the allocator.
+  const size_t tableSize = nodes * sizeof(node *);
+  node ** table = (node **) mmap (NULL, tableSize, PROT_READ | PROT_WRITE,
+				  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (table == MAP_FAILED) {
+    perror ("mmap");
+    return 1;
+  }
+  memset (table, 0, tableSize);
+
+  const long before = residentKB();
+
+  HL::Timer t;
+  t.start();
+
+  for (int i = 0; i < nodes; i++) {
+    table[i] = (node *) allocate (sizeof(node));
+    table[i]->symbol = i;
+    table[i]->next = i + 1;
+  }
+  for (int i = 0; i < nodes; i += 2) {
+    free (table[i]);
+  }
+  for (int i = 0; i < nodes; i += 2) {
+    table[i] = (node *) allocate (sizeof(node));
+    table[i]->symbol = i;
+    table[i]->next = i + 1;
+  }
+
+  t.stop();
+
+  const long after = residentKB();
+
+  printf ("Time elapsed = %f seconds.\n", (double) t);
+  printf ("RSS growth = %ld KB (%.1f bytes per node).\n",
+	  after - before, 1024.0 * (double) (after - before) / nodes);
+
+  for (int i = 0; i < nodes; i++) {
+    free (table[i]);
+  }
+  munmap (table, tableSize);
+  return 0;
+}
@@ -0,0 +1,267 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+/**
+ * @file   hoard.h
+ * @brief  Hoard-specific extensions to the malloc API.
+ * @note   Applications call these directly (link with libhoard, or
+ *         look them up with dlsym when Hoard is preloaded). Memory
+ *         they return is released with free(), unless noted.
+ */
+
+#ifndef HOARD_H
+#define HOARD_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /// @brief Allocate sz bytes. Requests of at most 8 bytes are only
+  /// 8-byte aligned, and each takes 8 bytes instead of malloc's 16.
+  void * hoard_malloc_small (size_t sz);
+
+  /// @brief Allocate sz bytes on cache lines of their own: the object
+  /// is 64-byte aligned, and no other object shares its lines.
+  void * hoard_malloc_isolated (size_t sz);
+
+  /// @brief Allocate a page-aligned buffer for direct I/O (O_DIRECT,
+  /// registered io_uring buffers) that stays resident: it is
+  /// prefaulted, never returned to the OS while in the pool, and
+  /// locked in memory if Hoard is built with HOARD_IO_BUFFER_MLOCK.
+  /// @note  Release it with hoard_io_free, not free.
+  void * hoard_io_malloc (size_t sz);
+
+  void hoard_io_free (void * ptr);
+
+  /// Resize a buffer from hoard_io_malloc, keeping it if it still fits.
+  void * hoard_io_realloc (void * ptr, size_t sz);
+
+  /// @brief Like realloc and calloc, but copies and clears of 1MB or
+  /// more (HOARD_STREAMING_THRESHOLD) use non-temporal stores, which
+  /// go around the caches, rather than evicting the working sets of
+  /// this and other threads (see streamingcopy.h).
+  void * hoard_realloc (void * ptr, size_t sz);
+
+  void * hoard_calloc (size_t n, size_t sz);
+
+  /// @brief Give the calling thread's heap the given number of extra
+  /// superblocks for objects of sz bytes (every small size when sz is
+  /// 0), with their pages faulted in now, so that allocations do not
+  /// take page faults later.
+  /// @return 0, or -1 if sz is too large or memory ran out.
+  /// @note  As the thread frees memory, its heap hands empty
+  ///        superblocks back to the global heap, still prefaulted.
+  int hoard_prewarm (size_t sz, int superblocks);
+
+  /// @brief Is ptr worth moving, for a program that compacts its own
+  /// data? Returns 1 if ptr lies in a superblock that is less full
+  /// than its heap's superblocks of the same size are on average, so
+  /// that moving its objects elsewhere (with hoard_malloc_no_tcache
+  /// and hoard_free_no_tcache) lets the superblock empty out and go
+  /// back to the global heap;
+  /// 0 otherwise, including for large objects.
+  /// @note  ptr must be NULL or an object allocated by Hoard.
+  int hoard_defrag_hint (void * ptr);
+
+  /// @brief Allocate sz bytes from the fullest superblock of the
+  /// calling thread's heap that has room, bypassing the thread's
+  /// cache of recently freed objects (see hoard_defrag_hint).
+  void * hoard_malloc_no_tcache (size_t sz);
+
+  /// @brief Free ptr straight to its superblock, bypassing the calling
+  /// thread's cache, so that a superblock being emptied by moving its
+  /// objects out (see hoard_defrag_hint) really empties.
+  void hoard_free_no_tcache (void * ptr);
+
+  /// Like hoard_prewarm, for the global heap, which every thread
+  /// draws from (see also HOARD_PREWARM_SUPERBLOCKS).
+  int hoard_prewarm_global (size_t sz, int superblocks);
+
+  /// Memory held by Hoard (see hoard_get_stats).
+  struct hoard_stats {
+    size_t heap_bytes;            ///< in the superblocks of the threads' heaps
+    size_t heap_in_use_bytes;     ///< in objects allocated from them, or cached by threads
+    size_t global_bytes;          ///< in the superblocks of the global heap
+    size_t global_in_use_bytes;   ///< in objects allocated from those
+    size_t global_heap_trips;     ///< times threads locked the global heap to move superblocks
+    size_t released_superblocks;  ///< empty superblocks maintenance has returned to the OS
+    size_t maintenance_passes;    ///< passes the maintenance thread has made
+    int memory_pressure;          ///< 0 (none), 1 (high) or 2 (critical)
+  };
+
+  /// @brief Start a background thread that, every intervalMs
+  /// milliseconds, trims memory off the allocation path: it returns
+  /// half of the global heap's empty superblocks to the OS (so memory
+  /// nobody asks for decays away), empties the large-object caches
+  /// that went unused since its last pass, and refreshes the
+  /// statistics that hoard_get_stats reports. If the thread is already
+  /// running, this only changes the interval. The thread stops at exit.
+  /// @return 0, or -1 if intervalMs is 0 or no thread could be made
+  ///         (always on Windows).
+  int hoard_maintenance_start (unsigned int intervalMs);
+
+  /// Stop the maintenance thread, and wait until it has.
+  void hoard_maintenance_stop (void);
+
+  /// @brief Have the maintenance thread watch the cgroup (v2) in
+  /// cgroupDir, or the process's own if cgroupDir is NULL, and give
+  /// memory back harder as usage nears its limit (memory.max or
+  /// memory.high) or its tasks stall on memory (memory.pressure).
+  /// Past 80% of the limit (or 10% of time stalled), each pass
+  /// returns all of the global heap's empty superblocks to the OS,
+  /// empties the large-object caches and lets them waste a quarter as
+  /// much; past 90% (or 40%), a sixteenth. Any directory holding
+  /// files of those names will do, to simulate limits.
+  /// @return 0, or -1 if there is nothing to watch there.
+  int hoard_watch_memory_pressure (const char * cgroupDir);
+
+  /// @brief Fill in stats, as of the maintenance thread's last pass
+  /// if it is running, or as of now (locking each heap in turn) if not.
+  void hoard_get_stats (struct hoard_stats * stats);
+
+  /// @brief Allocate from heap id (0 to 127) from now on, sharing it
+  /// with any other thread that does, instead of the heap Hoard picked
+  /// for the calling thread. The thread's cache of free objects goes
+  /// back to the old heap first. A scheduler that moves a worker's
+  /// tasks between threads can thus keep them on the worker's heap.
+  /// @return 0, or -1 if id is out of range or another thread's
+  ///         private heap (see hoard_private_heap), or if we are out
+  ///         of memory.
+  int hoard_set_heap (int id);
+
+  /// The id of the heap the calling thread allocates from.
+  int hoard_get_heap (void);
+
+  /// @brief Like hoard_set_heap, to a heap that no other thread uses
+  /// and that none can take until the calling thread moves to another
+  /// heap or exits.
+  /// @return the heap's id, or -1 if every heap is in use (or we are
+  ///         out of memory).
+  int hoard_private_heap (void);
+
+  /// @brief An allocation context: a cache of free objects, and a heap
+  /// behind it, that a fiber (or coroutine) carries from one thread to
+  /// the next, so that what it allocates and frees stays local to it
+  /// whichever thread runs it.
+  struct hoard_context;
+
+  /// @brief Make an allocation context, with heap id (as in
+  /// hoard_set_heap), or with a heap chosen as for a new thread if id
+  /// is -1.
+  /// @return the context, or NULL if id is out of range or another
+  ///         thread's private heap, or if we are out of memory.
+  struct hoard_context * hoard_context_create (int id);
+
+  /// @brief Allocate and free through ctx on the calling thread until
+  /// hoard_context_leave. A fiber scheduler calls this when it
+  /// switches a fiber in, and hoard_context_leave when it switches
+  /// the fiber out; both take a few stores and one short lock.
+  /// @note  A context serves one thread at a time. A thread that exits
+  ///        inside contexts leaves them first, so they outlive it.
+  void hoard_context_enter (struct hoard_context * ctx);
+
+  /// Go back to what the calling thread used before entering ctx.
+  void hoard_context_leave (struct hoard_context * ctx);
+
+  /// @brief Return the objects cached in ctx to their heaps, and free
+  /// ctx, which no thread may be in.
+  void hoard_context_destroy (struct hoard_context * ctx);
+
+  /// @brief An arena: a heap whose objects can all be freed at once,
+  /// as when a server is done with a request.
+  struct hoard_arena;
+
+  /// @return a new, empty arena, or NULL if we are out of memory.
+  struct hoard_arena * hoard_arena_create (void);
+
+  /// @brief Serve every malloc (and new) on the calling thread from
+  /// arena, until hoard_arena_pop, including those made by libraries
+  /// that know nothing of arenas. Pushes nest, up to 16 deep. Objects
+  /// larger than the biggest size class come from the usual heaps.
+  /// Arena objects may be freed one at a time, by any thread, which
+  /// lets the arena reuse their memory.
+  /// @return 0, or -1 if 16 arenas are pushed already.
+  /// @note  The scope belongs to the calling thread, or to the
+  ///        allocation context it is in (see hoard_context_enter). Pop
+  ///        every arena pushed before the thread (or context) goes.
+  int hoard_arena_push (struct hoard_arena * arena);
+
+  /// Go back to the arena (if any) pushed before the last one.
+  void hoard_arena_pop (void);
+
+  /// @brief Allocate sz bytes from arena, whether or not it is pushed.
+  /// @return the object, or NULL if sz is larger than the biggest size
+  ///         class or we are out of memory.
+  void * hoard_arena_malloc (struct hoard_arena * arena, size_t sz);
+
+  /// @brief Like hoard_arena_create, but the arena's objects all lie in
+  /// one 4GB window of address space, which every compact arena
+  /// shares, so that pointer-heavy structures can store 32-bit offsets
+  /// from its base (see hoard_compact_encode) instead of pointers.
+  /// Objects too big for the arena (see hoard_arena_push) are not in
+  /// the window; allocate nodes with hoard_arena_malloc to be sure.
+  /// @return the arena, or NULL if no window could be reserved (or
+  ///         this 64-bit build has none, as on Windows) or we are out
+  ///         of memory (including room in the window).
+  struct hoard_arena * hoard_arena_create_compact (void);
+
+  /// @brief The base of the compact arenas' window: HOARD_COMPACT_BASE
+  /// (by default 0x100000000000) if that range was free, or wherever
+  /// it fit. It never moves.
+  /// @return the base, or NULL if no window could be reserved, or in
+  ///         32-bit builds, where every address already fits.
+  void * hoard_compact_base (void);
+
+  /// @brief The 32-bit offset of ptr, an object in a compact arena,
+  /// from base (see hoard_compact_base). NULL becomes 0, which no
+  /// object has.
+  static inline unsigned int hoard_compact_encode (const void * base, const void * ptr) {
+    return ptr ? (unsigned int) ((const char *) ptr - (const char *) base) : 0;
+  }
+
+  /// The object at offset from base (see hoard_compact_encode).
+  static inline void * hoard_compact_decode (const void * base, unsigned int offset) {
+    return offset ? (void *) ((const char *) base + offset) : NULL;
+  }
+
+  /// @brief Free every object in arena at once, in time proportional
+  /// to the memory it holds rather than to the number of objects, and
+  /// then arena itself. Its memory goes to the global heap, for any
+  /// thread or arena to reuse.
+  /// @note  No thread may have arena pushed, or use its objects again.
+  ///        An arena that was in use in another thread when the
+  ///        process forked must not be used in the child.
+  void hoard_arena_destroy (struct hoard_arena * arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
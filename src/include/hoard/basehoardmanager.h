@@ -39,6 +39,15 @@
 
 namespace Hoard {
 
+  /// @brief The kinds of heap that can own a superblock, which
+  /// superblocks record along with their owner so that frees can reach
+  /// it without a virtual call (see RedirectFree).
+  enum OwnerKind {
+    ThreadHeapOwner = 0,
+    GlobalHeapOwner = 1,
+    ArenaHeapOwner = 2    ///< see ArenaHeap
+  };
+
   template <class SuperblockType_>
   class BaseHoardManager {
   public:
@@ -69,6 +69,19 @@ namespace Hoard {
     }
 
 
+    /// Apply f to every superblock we hold.
+    template <class Function>
+    void forEach (Function& f) {
+      for (int i = 0; i <= EmptinessClasses + 1; i++) {
+	SuperblockType * s = _available(i);
+	while (s) {
+	  SuperblockType * next = s->getNext();
+	  f (s);
+	  s = next;
+	}
+      }
+    }
+
     SuperblockType * getEmpty (void) {
       Check<EmptyClass, MyChecker> check (this);
       SuperblockType * s = _available(0);
@@ -86,6 +99,15 @@ namespace Hoard {
       return 0;
     }
 
+    /// How many completely empty superblocks we hold.
+    int getEmptyCount (void) const {
+      int n = 0;
+      for (SuperblockType * s = _available(0); s; s = s->getNext()) {
+	n++;
+      }
+      return n;
+    }
+
     SuperblockType * get (void) {
       Check<EmptyClass, MyChecker> check (this);
       // Return as empty a superblock as possible
@@ -129,6 +151,25 @@ namespace Hoard {
       return 0;
     }
 
+    /// @brief Remove and return any superblock, full ones included
+    /// (which get leaves alone, since they have nothing to allocate).
+    SuperblockType * getAny (void) {
+      Check<EmptyClass, MyChecker> check (this);
+      for (int n = 0; n <= EmptinessClasses + 1; n++) {
+	SuperblockType * s = _available(n);
+	if (s) {
+	  _available(n) = s->getNext();
+	  if (_available(n)) {
+	    _available(n)->setPrev (0);
+	  }
+	  s->setPrev (0);
+	  s->setNext (0);
+	  return s;
+	}
+      }
+      return 0;
+    }
+
     void put (SuperblockType * s) {
       Check<EmptyClass, MyChecker> check (this);
 
@@ -178,6 +219,34 @@ namespace Hoard {
       return NULL;
     }
 
+    /// @brief Remove and return the fullest superblock with room,
+    /// looking past the head of its fullness class.
+    /// @note  Walks a whole list, so it is meant for the slow path.
+    SuperblockType * getFullest (void) {
+      Check<EmptyClass, MyChecker> check (this);
+      for (int i = EmptinessClasses; i >= 0; i--) {
+	SuperblockType * best = NULL;
+	for (SuperblockType * s = _available(i); s; s = s->getNext()) {
+	  if (!best || (s->getObjectsFree() < best->getObjectsFree())) {
+	    best = s;
+	  }
+	}
+	if (best) {
+	  SuperblockType * prev = best->getPrev();
+	  SuperblockType * next = best->getNext();
+	  if (prev) { prev->setNext (next); }
+	  if (next) { next->setPrev (prev); }
+	  if (best == _available(i)) {
+	    _available(i) = next;
+	  }
+	  best->setPrev (0);
+	  best->setNext (0);
+	  return best;
+	}
+      }
+      return 0;
+    }
+
     INLINE void free (void * ptr) {
       Check<EmptyClass, MyChecker> check (this);
       SuperblockType * s = getSuperblock (ptr);
@@ -56,6 +56,8 @@ namespace Hoard {
 
     SuperblockType * get (size_t, EmptyHoardManager *) { abort(); return NULL; }
     void put (SuperblockType *, size_t) { abort(); }
+    int getBatch (size_t, EmptyHoardManager *, SuperblockType **, int) { abort(); return 0; }
+    void putBatch (SuperblockType **, int, size_t) { abort(); }
 
   private:
 
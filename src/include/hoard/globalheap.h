@@ -75,6 +75,63 @@ namespace Hoard {
       return s;
     }
 
+    /// Put n superblocks in one trip (see HoardManager).
+    void putBatch (SuperblockType ** sbs, int n, size_t sz) {
+      _theHeap->putBatch ((typename SuperHeap::SuperblockType **) sbs, n, sz);
+    }
+
+    /// Get up to max superblocks in one trip (see HoardManager).
+    int getBatch (size_t sz, void * dest, SuperblockType ** sbs, int max) {
+      return _theHeap->getBatch (sz, reinterpret_cast<SuperHeap *>(dest),
+				 (typename SuperHeap::SuperblockType **) sbs, max);
+    }
+
+    /// Get up to max empty superblocks, owned by a heap of the given kind (see HoardManager).
+    int getEmptyBatch (size_t sz, void * dest, SuperblockType ** sbs, int max, int kind) {
+      return _theHeap->getEmptyBatch (sz, reinterpret_cast<SuperHeap *>(dest),
+				      (typename SuperHeap::SuperblockType **) sbs, max, kind);
+    }
+
+    /// How many times thread heaps have locked this one to move superblocks.
+    unsigned long getTransferTrips (void) const {
+      return _theHeap->getTransferTrips();
+    }
+
+    void lock (void) {
+      _theHeap->lock();
+    }
+
+    void unlock (void) {
+      _theHeap->unlock();
+    }
+
+    /// Add n prefaulted superblocks of sz's size class (see HoardManager).
+    bool prewarm (size_t sz, int n) {
+      return _theHeap->prewarm (sz, n);
+    }
+
+    /// Return half (or all) of the empty superblocks to the OS (see HoardManager).
+    int releaseEmpty (bool all) {
+      return _theHeap->releaseEmpty (all);
+    }
+
+#if HOARD_MESH
+    /// Mesh the size classes that took in superblocks lately (see ProcessHeap).
+    void mesh (void) {
+      _theHeap->mesh();
+    }
+#endif
+
+    /// Add up the superblock and in-use bytes here (see HoardManager).
+    void getTotals (size_t& allocated, size_t& inUse) {
+      _theHeap->getTotals (allocated, inUse);
+    }
+
+    template <class Function>
+    void forEachSuperblock (Function& f) {
+      _theHeap->forEachSuperblock (f);
+    }
+
   private:
 
     SuperHeap * _theHeap;
@@ -32,6 +32,7 @@
 
 #include "hoardconstants.h"
 #include "heaplayers.h"
+#include "array.h"
 
 namespace Hoard {
 
@@ -44,15 +45,13 @@ namespace Hoard {
 
     HeapManager (void)
     {
-      HL::Guard<LockType> g (heapLock);
-      
-      /// Initialize all heap maps (nothing yet assigned).
-      int i;
-      for (i = 0; i < HeapType::MaxThreads; i++) {
-	HeapType::setTidMap (i, 0);
-      }
-      for (i = 0; i < HeapType::MaxHeaps; i++) {
-	HeapType::setInusemap (i, 0);
+      // The heap maps start out cleared (nothing yet assigned), and no
+      // heap is private. As in ThreadPoolHeap, only store into entries
+      // that are not already clear.
+      for (int i = 0; i < HeapType::MaxHeaps; i++) {
+	if (_private(i)) {
+	  _private(i) = false;
+	}
       }
     }
 
@@ -69,48 +68,226 @@ namespace Hoard {
       unsigned long tid_original = HL::CPUInfo::getThreadId();
       unsigned int tid = (unsigned int) (tid_original % HeapType::MaxThreads);
       
-      int i = 0;
+      int i = acquireUnusedHeap();
+      HeapType::setTidMap (tid, i);
+      
+      return i;
+    }
+
+    /// @brief Take a reference on heapIndex, or if it is -1, on a
+    /// heap chosen as findUnusedHeap would, without giving it to the
+    /// calling thread (see hoard_context_create).
+    /// @return the heap (give it back with dropHeapReference), or -1
+    /// as for bindHeap.
+    int acquireHeap (int heapIndex) {
+      HL::Guard<LockType> g (heapLock);
+      if (heapIndex == -1) {
+	return acquireUnusedHeap();
+      }
+      return takeHeap (heapIndex, -1) ? heapIndex : -1;
+    }
+
+    /// Give back a heap from acquireHeap.
+    void dropHeapReference (int heapIndex) {
+      HL::Guard<LockType> g (heapLock);
+      dropHeap (heapIndex);
+    }
+
+    /// @brief Serve the calling thread from heapIndex, until further
+    /// notice, without taking a reference: a fiber scheduler calls
+    /// this on every switch (see hoard_context_enter).
+    /// @return the heap that served the thread until now.
+    /// @note  The caller holds a reference on heapIndex.
+    int switchHeap (int heapIndex) {
+      // Threads that share our slot in the map may be binding or
+      // releasing heaps at the same time.
+      HL::Guard<LockType> g (heapLock);
+      int tid = HL::CPUInfo::getThreadId() & (HeapType::MaxThreads - 1);
+      const int previous = HeapType::getTidMap (tid);
+      HeapType::setTidMap (tid, heapIndex);
+      return previous;
+    }
+
+    /// @brief The calling thread is done with heapIndex, the heap
+    /// that findUnusedHeap gave it. (Its slot in the thread map may
+    /// since have gone to another thread with the same slot.)
+    void releaseHeap (int heapIndex) {
+      // Decrement the ref-count on the heap.
+      
+      HL::Guard<LockType> g (heapLock);
+      
+      // Statically ensure that the number of threads is a power of two.
+      enum { VerifyPowerOfTwo = 1 / ((HeapType::MaxThreads & ~(HeapType::MaxThreads-1))) };
+      
+      int tid = HL::CPUInfo::getThreadId() & (HeapType::MaxThreads - 1);
+      int current = HeapType::getTidMap (tid);
+      
+      HeapType::unbiasHeap (current);
+      if (current == heapIndex) {
+	// Anything this thread allocates from now on goes to heap 0.
+	HeapType::setTidMap (tid, 0);
+      }
+
+      dropHeap (heapIndex);
+    }
+
+    /// @brief Move the calling thread from heap previous (which
+    /// findUnusedHeap or an earlier bindHeap gave it) to heapIndex,
+    /// which it then shares with any other thread bound to it. If
+    /// heapIndex is -1, take instead a heap that no thread uses, and
+    /// keep it private to the caller until it lets go.
+    /// @note  Threads are mapped to heaps by a hash of their id, which
+    /// several threads can share, so a private heap is not entered in
+    /// the map: the caller allocates from it directly (see HoardTLAB),
+    /// and its slot in the map is left to the threads that share it.
+    /// @return the heap, or -1 if heapIndex is out of range or another
+    /// thread's private heap, if no heap is free to make private, or
+    /// if we are out of memory.
+    /// @note  The caller first returns whatever it cached from the
+    /// previous heap (see hoard_set_heap).
+    int bindHeap (int heapIndex, int previous) {
+
+      HL::Guard<LockType> g (heapLock);
+
+      const bool makePrivate = (heapIndex == -1);
+      if (makePrivate) {
+	// As in findUnusedHeap, leave heap 0 out.
+	heapIndex = 1;
+	while ((heapIndex < HeapType::MaxHeaps) && HeapType::getInusemap (heapIndex))
+	  heapIndex++;
+	if (heapIndex >= HeapType::MaxHeaps) {
+	  return -1;
+	}
+      }
+      if (!takeHeap (heapIndex, previous)) {
+	return -1;
+      }
+      int tid = HL::CPUInfo::getThreadId() & (HeapType::MaxThreads - 1);
+      HeapType::unbiasHeap (HeapType::getTidMap (tid));
+      if (makePrivate) {
+	_private(heapIndex) = true;
+      } else {
+	HeapType::setTidMap (tid, heapIndex);
+      }
+
+      dropHeap (previous);
+      return heapIndex;
+    }
+
+    /// The heap that serves the calling thread.
+    int getHeapIndex (void) const {
+      int tid = HL::CPUInfo::getThreadId() & (HeapType::MaxThreads - 1);
+      return HeapType::getTidMap (tid);
+    }
+    
+    /// @brief Take every lock: the heap maps' first, then each heap's.
+    /// @note  Used around fork(); see xxmalloc_lock.
+    void lock (void) {
+      heapLock.lock();
+      HeapType::lockAll();
+    }
+
+    void unlock (void) {
+      HeapType::unlockAll();
+      heapLock.unlock();
+    }
+
+    /// @brief In a forked child, after unlock(): only the calling
+    /// thread survived, so every heap but the one its slot maps to
+    /// and its private heap (if it has one; see bindHeap) is free for
+    /// reuse.
+    void resetAfterFork (int privateHeap) {
+      int tid = HL::CPUInfo::getThreadId() & (HeapType::MaxThreads - 1);
+      int mine = HeapType::getTidMap (tid);
+      int inUse = HeapType::getInusemap (mine);
+      const bool minePrivate = _private(mine);
+      const int privateInUse = (privateHeap > 0) ? HeapType::getInusemap (privateHeap) : 0;
+      for (int i = 0; i < HeapType::MaxHeaps; i++) {
+	HeapType::setInusemap (i, 0);
+	_private(i) = false;
+      }
+      HeapType::setInusemap (mine, inUse);
+      _private(mine) = minePrivate;
+      if (privateHeap > 0) {
+	HeapType::setInusemap (privateHeap, privateInUse);
+	_private(privateHeap) = true;
+      }
+    }
+    
+  private:
+
+    /// @brief Take a reference on the first heap that nobody uses.
+    /// Call with heapLock held.
+    int acquireUnusedHeap (void) {
+      // Heap 0 belongs to the main thread (and to any thread that
+      // never asks for a heap of its own), so leave it out.
+      int i = 1;
       while ((i < HeapType::MaxHeaps) && (HeapType::getInusemap(i)))
 	i++;
       if (i >= HeapType::MaxHeaps) {
-	// Every heap is in use: pick a random heap.
+	// Every heap is in use: pick a random heap, other than the
+	// private ones (see bindHeap). Heap 0 is never private.
 #if defined(_WIN32)
 	int randomNumber = rand();
 #else
 	int randomNumber = (int) lrand48();
 #endif
 	i = randomNumber % HeapType::MaxHeaps;
+	while (_private(i)) {
+	  i = (i + 1) % HeapType::MaxHeaps;
+	}
       }
 
-      HeapType::setInusemap (i, 1);
-      HeapType::setTidMap (tid, i);
-      
+      if (!HeapType::materializeHeap (i)) {
+	// Out of memory: fall back to the heap that always exists.
+	i = 0;
+      }
+      HeapType::setInusemap (i, HeapType::getInusemap (i) + 1);
       return i;
     }
 
-    void releaseHeap (void) {
-      // Decrement the ref-count on the current heap.
-      
-      HL::Guard<LockType> g (heapLock);
-      
-      // Statically ensure that the number of threads is a power of two.
-      enum { VerifyPowerOfTwo = 1 / ((HeapType::MaxThreads & ~(HeapType::MaxThreads-1))) };
-      
-      int tid = HL::CPUInfo::getThreadId() & (HeapType::MaxThreads - 1);
-      int heapIndex = HeapType::getTidMap (tid);
-      
-      HeapType::setInusemap (heapIndex, 0);
+    /// @brief Take a reference on heapIndex, unless it is out of range
+    /// or private to a thread other than the one leaving heap
+    /// previous, or we are out of memory. Call with heapLock held.
+    bool takeHeap (int heapIndex, int previous) {
+      if ((heapIndex < 0) || (heapIndex >= HeapType::MaxHeaps)) {
+	return false;
+      }
+      if (_private(heapIndex) && (heapIndex != previous)) {
+	return false;
+      }
+      if (!HeapType::materializeHeap (heapIndex)) {
+	return false;
+      }
+      if (heapIndex != 0) {
+	HeapType::setInusemap (heapIndex, HeapType::getInusemap (heapIndex) + 1);
+      }
+      return true;
+    }
+
+    /// @brief One fewer thread uses heapIndex. Call with heapLock held.
+    void dropHeap (int heapIndex) {
+      if (heapIndex == 0) {
+	// Always in use (see findUnusedHeap).
+	return;
+      }
+
+      HeapType::setInusemap (heapIndex, HeapType::getInusemap (heapIndex) - 1);
       
       // Prevent underruns (defensive programming).
       
       if (HeapType::getInusemap (heapIndex) < 0) {
 	HeapType::setInusemap (heapIndex, 0);
       }
+
+      // If nobody else uses the heap, don't strand its memory until
+      // some later thread happens to pick it: give its superblocks back.
+      if (HeapType::getInusemap (heapIndex) == 0) {
+	_private(heapIndex) = false;
+	HeapType::releaseHeapMemory (heapIndex);
+      }
     }
     
-    
-  private:
-    
     // Disable copying.
     
     HeapManager (const HeapManager&);
@@ -118,6 +295,9 @@ namespace Hoard {
     
     /// The lock, to ensure mutual exclusion.
     LockType heapLock;
+
+    /// Which heaps belong to a single thread (see bindHeap).
+    Array<HeapType::MaxHeaps, bool> _private;
   };
 
 }
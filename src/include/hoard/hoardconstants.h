@@ -29,11 +29,20 @@
 #ifndef HOARD_HOARDCONSTANTS_H
 #define HOARD_HOARDCONSTANTS_H
 
+// Meshing happens on the maintenance thread (see hoardMaintain), so
+// it runs by default whenever meshing is on.
+#if HOARD_MESH && !defined(HOARD_MAINTENANCE_INTERVAL)
+#define HOARD_MAINTENANCE_INTERVAL 100
+#endif
+
 namespace Hoard {
   
   /// The maximum amount of memory that each TLAB may hold, in bytes.
   enum { MAX_MEMORY_PER_TLAB = 2 * 1024 * 1024 }; // 2MB
   
+  /// The size of a cache line, in bytes.
+  enum { CacheLineSize = 64 };
+
   /// The maximum number of threads supported (sort of).
   enum { MaxThreads = 2048 };
   
@@ -43,6 +52,24 @@ namespace Hoard {
   /// Size, in bytes, of the largest object we will cache on a
   /// thread-local allocation buffer.
   enum { LargestSmallObject = 256 };
+
+  /// The number of frees of objects owned by other threads' heaps
+  /// that a TLAB gathers before sending them back to their owners,
+  /// instead of caching them locally (0, the default, caches them
+  /// like any other).
+#if defined(HOARD_FOREIGN_FREE_BATCH)
+  enum { ForeignFreeBatch = HOARD_FOREIGN_FREE_BATCH };
+#else
+  enum { ForeignFreeBatch = 0 };
+#endif
+
+  /// Copies and clears of at least this many bytes bypass the caches
+  /// (see StreamingCopy).
+#if defined(HOARD_STREAMING_THRESHOLD)
+  enum { StreamingThreshold = HOARD_STREAMING_THRESHOLD };
+#else
+  enum { StreamingThreshold = 1024 * 1024 };
+#endif
     
 }
 
@@ -55,7 +55,20 @@ using namespace HL;
 #include "lockmallocheap.h"
 #include "alignedsuperblockheap.h"
 #include "alignedmmap.h"
+#include "bumpalloc.h"
+#include "forklock.h"
+#include "decayheap.h"
+#include "iobufferpool.h"
+#include "pagemap.h"
+#include "addresswindow.h"
+#if HOARD_BIASED_LOCK
+#include "biasedlock.h"
+#endif
+#if HOARD_MESH
+#include "mesharena.h"
+#endif
 #include "globalheap.h"
+#include "sizeclasses.h"
 
 #include "thresholdsegheap.h"
 #include "geometricsizeclass.h"
@@ -86,12 +99,44 @@ typedef HL::SpinLockType TheLockType;
 namespace Hoard {
 
   class MmapSource : public AlignedMmap<SUPERBLOCK_SIZE, TheLockType> {};
+
+  //
+  // Where small-object superblocks come from. With meshing enabled,
+  // they come from a memfd-backed arena so that sparse superblocks
+  // can later be meshed together (see mesher.h).
+  //
+
+#if HOARD_MESH
+  class SuperblockSource : public MeshArena<SUPERBLOCK_SIZE, TheLockType> {};
+#else
+  class SuperblockSource : public MmapSource {};
+#endif
+
+  //
+  // With the page map, small-object superblocks and large objects are
+  // marked as they are mapped, so that telling our pointers from
+  // foreign ones needs no header (see HoardSuperblock::isOwned).
+  //
+
+  typedef PageMap<SUPERBLOCK_SIZE> ThePageMap;
+
+#if HOARD_PAGE_MAP
+  class SmallSuperblockSource :
+    public PageMapHeap<SUPERBLOCK_SIZE, ThePageMap::Superblock, ThePageMap::Superblock, SuperblockSource> {};
+
+  class BigBlockSource :
+    public PageMapHeap<SUPERBLOCK_SIZE, ThePageMap::BigBlock, ThePageMap::BigBlockTail, MmapSource> {};
+#else
+  class SmallSuperblockSource : public SuperblockSource {};
+
+  class BigBlockSource : public MmapSource {};
+#endif
   
   //
   // There is just one "global" heap, shared by all of the per-process heaps.
   //
 
-  typedef GlobalHeap<SUPERBLOCK_SIZE, EMPTINESS_CLASSES, MmapSource, TheLockType>
+  typedef GlobalHeap<SUPERBLOCK_SIZE, EMPTINESS_CLASSES, SmallSuperblockSource, TheLockType>
   TheGlobalHeap;
   
   //
@@ -115,6 +160,20 @@ namespace Hoard {
   };
   
 
+  //
+  // A thread's heap is nearly always locked by that thread alone, so
+  // with biased locking, that thread skips the atomic operations.
+  //
+
+#if HOARD_BIASED_LOCK
+  class ThreadHeapLock : public BiasedLock<TheLockType> {};
+#else
+  class ThreadHeapLock : public TheLockType {
+  public:
+    void unbias (void) {}
+  };
+#endif
+
   class SmallHeap;
   
   typedef HoardSuperblock<TheLockType, SUPERBLOCK_SIZE, SmallHeap> SmallSuperblockType;
@@ -124,15 +183,156 @@ namespace Hoard {
   //
   class SmallHeap : 
     public ConformantHeap<
-    HoardManager<AlignedSuperblockHeap<TheLockType, SUPERBLOCK_SIZE, MmapSource>,
+    HoardManager<AlignedSuperblockHeap<TheLockType, SUPERBLOCK_SIZE, SmallSuperblockSource>,
 		 TheGlobalHeap,
 		 SmallSuperblockType,
 		 EMPTINESS_CLASSES,
-		 TheLockType,
+		 ThreadHeapLock,
 		 hoardThresholdFunctionClass,
 		 SmallHeap> > 
   {};
 
+  //
+  // Compact arenas carve their superblocks out of one 4GB window, at
+  // HOARD_COMPACT_BASE if that is free, so that a 32-bit offset from
+  // its base names any of their objects (see hoard_arena_create_compact).
+  //
+
+#if HOARD_ADDRESS_WINDOW
+#if !defined(HOARD_COMPACT_BASE)
+#define HOARD_COMPACT_BASE 0x100000000000UL
+#endif
+
+  class CompactWindow :
+    public AddressWindow<SUPERBLOCK_SIZE, HOARD_COMPACT_BASE, TheLockType> {};
+
+#if HOARD_PAGE_MAP
+  class CompactSuperblockSource :
+    public PageMapHeap<SUPERBLOCK_SIZE, ThePageMap::Superblock, ThePageMap::Superblock, CompactWindow> {};
+#else
+  class CompactSuperblockSource : public CompactWindow {};
+#endif
+#endif
+
+  class ArenaHeap;
+
+  typedef HoardSuperblock<TheLockType, SUPERBLOCK_SIZE, ArenaHeap> ArenaSuperblockType;
+
+  //
+  // Arenas take only empty superblocks from the global heap, since
+  // they throw away their objects wholesale (see HoardManager::discardAll),
+  // and build new ones here when it has none. Compact arenas take and
+  // return superblocks in the window only.
+  //
+  class ArenaParentHeap : public TheGlobalHeap {
+  public:
+
+    ArenaParentHeap (void)
+      : _compact (false)
+    {}
+
+    /// Use superblocks in the compact window only, from now on.
+    void setCompact (void) {
+      _compact = true;
+    }
+
+    // Out of line, as the global heap's are: our callers hold these
+    // superblocks as their own type.
+
+    NO_INLINE int getBatch (size_t sz, void * dest, SuperblockType ** sbs, int max) {
+      void * ptr;
+      if (_compact) {
+	ptr = compactMalloc();
+      } else {
+	const int n = getEmptyBatch (sz, dest, sbs, max, ArenaHeapOwner);
+	if (n > 0) {
+	  return n;
+	}
+	ptr = _source.malloc (SUPERBLOCK_SIZE);
+      }
+      if (ptr == NULL) {
+	return 0;
+      }
+      sbs[0] = new (ptr) SuperblockType (sz);
+      return 1;
+    }
+
+    NO_INLINE void putBatch (SuperblockType ** sbs, int n, size_t sz) {
+      if (_compact) {
+	for (int i = 0; i < n; i++) {
+	  compactFree (sbs[i]);
+	}
+      } else {
+	TheGlobalHeap::putBatch (sbs, n, sz);
+      }
+    }
+
+    void put (SuperblockType * s, size_t sz) {
+      putBatch (&s, 1, sz);
+    }
+
+  private:
+
+    static void * compactMalloc (void) {
+#if HOARD_ADDRESS_WINDOW
+      return CompactSuperblockSource().malloc (SUPERBLOCK_SIZE);
+#else
+      return NULL;
+#endif
+    }
+
+    static void compactFree (void * ptr) {
+#if HOARD_ADDRESS_WINDOW
+      CompactSuperblockSource().free (ptr);
+#else
+      (void) ptr;
+#endif
+    }
+
+    bool _compact;
+
+    /// Where new (non-compact) superblocks come from.
+    AlignedSuperblockHeap<TheLockType, SUPERBLOCK_SIZE, SmallSuperblockSource> _source;
+  };
+
+  //
+  // Arenas build every superblock through their parent, so that a
+  // compact arena never falls back to memory outside the window.
+  //
+  class NoSuperblockSource {
+  public:
+    enum { Alignment = SUPERBLOCK_SIZE };
+    void * malloc (size_t) {
+      return NULL;
+    }
+    void release (void *) {}
+  };
+
+  class arenaThresholdFunctionClass {
+  public:
+    static inline bool function (int, int, size_t) {
+      // An arena keeps its superblocks until it goes.
+      return false;
+    }
+  };
+
+  //
+  // The heap behind an arena (see hoard_arena_create): like a thread's
+  // small-object heap, except that it gives its superblocks back to
+  // its parent only all at once, with every object in them.
+  //
+  class ArenaHeap :
+    public ConformantHeap<
+    HoardManager<NoSuperblockSource,
+		 ArenaParentHeap,
+		 ArenaSuperblockType,
+		 EMPTINESS_CLASSES,
+		 TheLockType,
+		 arenaThresholdFunctionClass,
+		 ArenaHeap,
+		 ArenaHeapOwner> >
+  {};
+
   class BigHeap;
 
   typedef HoardSuperblock<TheLockType, SUPERBLOCK_SIZE, BigHeap> BigSuperblockType;
@@ -157,35 +357,65 @@ namespace Hoard {
 
   class objectSource : public AddHeaderHeap<BigSuperblockType,
 					    SUPERBLOCK_SIZE,
-					    MmapSource> {};
-
-  typedef HL::ThreadHeap<64, HL::LockedHeap<TheLockType,
-					    ThresholdSegHeap<25,      // % waste
-							     1048576, // at least 1MB in any heap
-							     80,      // num size classes
-							     GeometricSizeClass<20>::size2class,
-							     GeometricSizeClass<20>::class2size,
-							     GeometricSizeClass<20>::MaxObjectSize,
-							     AdaptHeap<DLList, objectSource>,
-							     objectSource> > >
-  bigHeapType;
+					    BigBlockSource> {};
+
+  // The large-object heaps' locks, which we need to reach around fork().
+  class BigHeapLock : public ForkLock<TheLockType, 64> {};
+
+  // One of the large-object heaps, which the maintenance thread
+  // decays when their cached memory goes unused (see hoardMaintain).
+  class BigHeapShard :
+    public DecayHeap<TheLockType, 64,
+		     HL::LockedHeap<BigHeapLock,
+				    ThresholdSegHeap<25,      // % waste
+						     1048576, // at least 1MB in any heap
+						     80,      // num size classes
+						     GeometricSizeClass<20>::size2class,
+						     GeometricSizeClass<20>::class2size,
+						     GeometricSizeClass<20>::MaxObjectSize,
+						     AdaptHeap<DLList, objectSource>,
+						     objectSource> > > {};
+
+  typedef HL::ThreadHeap<64, BigHeapShard> bigHeapType;
 #endif
 
   class BigHeap : public bigHeapType {};
 
   enum { BigObjectSize = 
-	 HL::bins<SmallSuperblockType::Header, SUPERBLOCK_SIZE>::BIG_OBJECT };
+	 SizeClasses<SmallSuperblockType::Header, SUPERBLOCK_SIZE>::BIG_OBJECT };
+
+  //
+  // Buffers for direct I/O: page-aligned, 4KB to 1MB, carved from
+  // prefaulted 2MB (huge page) regions (see hoard_io_malloc).
+  //
+  enum { IORegionSize = 2 * 1048576 };
+
+  class IOBufferPoolType :
+    public IOBufferPool<IORegionSize, 4096, 1048576,
+			8192, // regions (16GB)
+			TheLockType,
+			AlignedMmap<IORegionSize, TheLockType> > {};
 
   //
   // Each thread has its own heap for small objects.
   //
   class PerThreadHoardHeap :
     public RedirectFree<LockMallocHeap<SmallHeap>,
-			SmallSuperblockType> {
+			SmallSuperblockType,
+			SmallHeap,
+			TheGlobalHeap::SuperHeap,
+			ArenaHeap> {
   private:
     // Avoid false sharing.
     char _dummy[64];
   };
+
+  //
+  // Per-thread heaps are only built once a thread needs one, and are
+  // carved out of superblock-sized chunks.
+  //
+  class PerThreadHeapSource :
+    public BumpAlloc<SUPERBLOCK_SIZE, SuperblockSource> {};
   
 
   template <int N, int NH>
@@ -193,7 +423,8 @@ namespace Hoard {
     public HL::ANSIWrapper<
     IgnoreInvalidFree<
       HL::HybridHeap<Hoard::BigObjectSize,
-		     ThreadPoolHeap<N, NH, Hoard::PerThreadHoardHeap>,
+		     ThreadPoolHeap<N, NH, Hoard::PerThreadHoardHeap,
+				    Hoard::PerThreadHeapSource>,
 		     Hoard::BigHeap> > >
   {
   public:
@@ -38,6 +38,8 @@
 #include "manageonesuperblock.h"
 #include "basehoardmanager.h"
 #include "emptyhoardmanager.h"
+#include "sizeclasses.h"
+#include "prefault.h"
 
 
 #include "heaplayers.h"
@@ -48,6 +50,9 @@ using namespace HL;
  *
  * @class HoardManager
  * @brief Manages superblocks by emptiness, returning them to the parent heap when empty enough.
+ *
+ * Superblocks on this heap record it as their owner, tagged with
+ * Kind (see OwnerKind).
  * @author Emery Berger <http://www.cs.umass.edu/~emery>
  *
  **/
@@ -60,15 +65,24 @@ namespace Hoard {
 	    int EmptinessClasses,
 	    class LockType,
 	    class thresholdFunctionClass,
-	    class HeapType>
+	    class HeapType,
+	    int Kind = ThreadHeapOwner>
   class HoardManager : public BaseHoardManager<SuperblockType_>,
 		       public thresholdFunctionClass
   {
   public:
 
     HoardManager (void)
-      : _magic (MAGIC_NUMBER)
-    {}
+      : _magic (MAGIC_NUMBER),
+	_transferTrips (0)
+    {
+      for (int i = 0; i < NumBins; i++) {
+	_fetchBatch(i) = 1;
+#if HOARD_MESH
+	_compactPending(i) = false;
+#endif
+      }
+    }
 
     virtual ~HoardManager (void) {}
 
@@ -76,12 +90,14 @@ namespace Hoard {
 
     enum { Alignment = SuperblockType::Header::Alignment };
 
+    /// Requests this small (see hoard_malloc_small) get tiny objects.
+    enum { TinyObjectSize = SuperblockType::Header::TinyObjectSize };
 
     MALLOC_FUNCTION INLINE void * malloc (size_t sz)
     {
       Check<HoardManager, sanityCheck> check (this);
-      const int binIndex = binType::getSizeClass(sz);
-      size_t realSize = binType::getClassSize (binIndex);
+      const int binIndex = getSizeClass(sz);
+      size_t realSize = getClassSize (binIndex);
       assert (realSize >= sz);
 
       // Iterate until we succeed in allocating memory.
@@ -90,50 +106,104 @@ namespace Hoard {
 	ptr = slowPathMalloc (realSize);
       }
       assert (SuperHeap::getSize(ptr) >= sz);
-      assert ((size_t) ptr % Alignment == 0);
+      assert ((size_t) ptr % ((realSize < Alignment) ? realSize : (size_t) Alignment) == 0);
       return ptr;
     }
 
 
-    /// Put a superblock on this heap.
-    NO_INLINE void put (SuperblockType * s, size_t sz) {
-      HL::Guard<LockType> l (_theLock);
-
-      assert (s->getOwner() != this);
+    /// @brief Allocate from the fullest superblock with room, so that
+    /// objects moved out of sparse superblocks pack densely (see
+    /// hoard_malloc_no_tcache).
+    MALLOC_FUNCTION NO_INLINE void * mallocDense (size_t sz)
+    {
       Check<HoardManager, sanityCheck> check (this);
+      const int binIndex = getSizeClass(sz);
+      size_t realSize = getClassSize (binIndex);
+      void * ptr = getObject (binIndex, realSize, true);
+      if (!ptr) {
+	ptr = slowPathMalloc (realSize);
+      }
+      return ptr;
+    }
 
-      const int binIndex = binType::getSizeClass(sz);
 
-      // Check to see whether this superblock puts us over.
-      Statistics& stats = _stats(binIndex);
-      int a = stats.getAllocated() + s->getTotalObjects();
-      int u = stats.getInUse() + (s->getTotalObjects() - s->getObjectsFree());
+    /// Put a superblock on this heap.
+    NO_INLINE void put (SuperblockType * s, size_t sz) {
+      HL::Guard<LockType> l (_theLock);
+      _transferTrips++;
+      putOne (s, sz);
+    }
 
-      if (thresholdFunctionClass::function (u, a, sz)) {
-	// We've crossed the threshold function,
-	// so we move this superblock up to the parent.
-	_ph.put (reinterpret_cast<typename ParentHeap::SuperblockType *>(s), sz);
-      } else {
-	unlocked_put (s, sz);
+    /// Put n superblocks, all of sz's size class, on this heap at once.
+    NO_INLINE void putBatch (SuperblockType ** sbs, int n, size_t sz) {
+      HL::Guard<LockType> l (_theLock);
+      _transferTrips++;
+      for (int i = 0; i < n; i++) {
+	putOne (sbs[i], sz);
       }
     }
 
-
     /// Get an empty (or nearly-empty) superblock.
     NO_INLINE SuperblockType * get (size_t sz, HeapType * dest) {
+      SuperblockType * s = NULL;
+      getBatch (sz, dest, &s, 1);
+      // printf ("getting sb %x (size %d) on %x\n", (void *) s, sz, (void *) this);
+      return s;
+    }
+
+    /// @brief Get up to max of the emptiest superblocks of sz's size
+    /// class at once, into sbs.
+    /// @return how many we got.
+    NO_INLINE int getBatch (size_t sz, HeapType * dest, SuperblockType ** sbs, int max) {
       HL::Guard<LockType> l (_theLock);
       Check<HoardManager, sanityCheck> check (this);
-      const int binIndex = binType::getSizeClass (sz);
-      SuperblockType * s = _otherBins(binIndex).get();
-      if (s) {
+      _transferTrips++;
+      const int binIndex = getSizeClass (sz);
+      int n = 0;
+      while (n < max) {
+	SuperblockType * s = _otherBins(binIndex).get();
+	if (!s) {
+	  break;
+	}
 	assert (s->isValidSuperblock());
       
 	// Update the statistics, removing objects in use and allocated for s.
 	decStatsSuperblock (s, binIndex);
-	s->setOwner (dest);
+	// Only thread heaps take superblocks from a parent.
+	s->setOwner (dest, ThreadHeapOwner);
+	sbs[n++] = s;
       }
-      // printf ("getting sb %x (size %d) on %x\n", (void *) s, sz, (void *) this);
-      return s;
+      return n;
+    }
+
+    /// @brief Like getBatch, but only superblocks with no objects in
+    /// use, for a heap of the given kind (see OwnerKind) that may
+    /// throw away the objects in its superblocks wholesale (see
+    /// ArenaHeap).
+    NO_INLINE int getEmptyBatch (size_t sz, HeapType * dest, SuperblockType ** sbs, int max, int kind) {
+      HL::Guard<LockType> l (_theLock);
+      Check<HoardManager, sanityCheck> check (this);
+      _transferTrips++;
+      const int binIndex = getSizeClass (sz);
+      int n = 0;
+      while (n < max) {
+	SuperblockType * s = _otherBins(binIndex).getEmpty();
+	if (!s) {
+	  break;
+	}
+	assert (s->isValidSuperblock());
+	decStatsSuperblock (s, binIndex);
+	s->setOwner (dest, kind);
+	sbs[n++] = s;
+      }
+      return n;
+    }
+
+    /// @brief How many times other heaps have locked this one to put
+    /// or get superblocks (see hoard_get_stats).
+    /// @note  Reads without locking.
+    unsigned long getTransferTrips (void) const {
+      return _transferTrips;
     }
 
     /// Return one object to its superblock and update stats.
@@ -145,13 +215,16 @@ namespace Hoard {
  
       assert (s->getOwner() == this);
 
+      // The pointer may refer to a meshed alias of this superblock.
+      ptr = s->canonicalize (ptr);
+
       // Find out which bin it belongs to.
       // Note that we assume that all pointers have been correctly
       // normalized at this point.
       assert (s->normalize (ptr) == ptr);
 
       const size_t sz = s->getObjectSize ();
-      const int binIndex = binType::getSizeClass (sz);
+      const int binIndex = getSizeClass (sz);
 
       // Free the object.
       _otherBins(binIndex).free (ptr);
@@ -165,15 +238,211 @@ namespace Hoard {
 	u--;
       stats.setInUse (u);
 
-      // Free up a superblock if we've crossed the emptiness threshold.
+      // Free up superblocks if we've crossed the emptiness threshold,
+      // allowing for the extra ones that the last batch brought in.
 
-      if (thresholdFunctionClass::function (u, a, sz)) {
+      const int slack = (_fetchBatch(binIndex) - 1) * (int) s->getTotalObjects();
+      if (thresholdFunctionClass::function (u + slack, a, sz)) {
 
 	slowPathFree (binIndex, u, a);
 
       }
     }
 
+    /// @brief Add n new superblocks of sz's size class to this heap,
+    /// with their pages already faulted in, so that carving objects
+    /// out of them later takes no page faults (see hoard_prewarm).
+    /// @return false if we ran out of memory first.
+    NO_INLINE bool prewarm (size_t sz, int n) {
+      HL::Guard<LockType> l (_theLock);
+      Check<HoardManager, sanityCheck> check (this);
+      const size_t realSize = getClassSize (getSizeClass (sz));
+      for (int i = 0; i < n; i++) {
+	SuperblockType * sb = makeSuperblock (realSize, true);
+	if (!sb) {
+	  return false;
+	}
+	unlocked_put (sb, realSize);
+      }
+      return true;
+    }
+
+    /// @brief Is s less full than this heap's superblocks of its size
+    /// class are on average? Its objects are then worth moving, so
+    /// that it can empty out (see hoard_defrag_hint). The superblock
+    /// we allocate from never is: moved objects go there.
+    /// @note  Reads without locking, so the answer is only a hint.
+    bool isSparse (SuperblockType * s) {
+      const int binIndex = getSizeClass (s->getObjectSize());
+      if (_otherBins(binIndex).isCurrent (s)) {
+	return false;
+      }
+      const Statistics& stats = _stats(binIndex);
+      const unsigned long long total = s->getTotalObjects();
+      const unsigned long long live = total - s->getObjectsFree();
+      // live / total < inUse / allocated
+      return (live < total) && (live * stats.getAllocated() < (unsigned long long) stats.getInUse() * total);
+    }
+
+    /// @brief Return half (rounding up) of the empty superblocks of
+    /// each size class to the source for good, so that memory nobody
+    /// asks for decays away over repeated calls (see hoardMaintain),
+    /// or all of them if all is true.
+    /// @return how many superblocks went back.
+    NO_INLINE int releaseEmpty (bool all) {
+      HL::Guard<LockType> l (_theLock);
+      Check<HoardManager, sanityCheck> check (this);
+      int released = 0;
+      for (int i = 0; i < NumBins; i++) {
+	const int empty = _otherBins(i).getEmptyCount();
+	for (int n = all ? empty : (empty + 1) / 2; n > 0; n--) {
+	  SuperblockType * s = _otherBins(i).getEmpty();
+	  if (!s) {
+	    break;
+	  }
+	  decStatsSuperblock (s, i);
+	  _sourceHeap.release (s);
+	  released++;
+	}
+      }
+      return released;
+    }
+
+    /// @brief Give up every superblock: empty ones to the source for
+    /// good, and the rest to the parent heap (see
+    /// HeapManager::releaseHeap).
+    /// @return how many superblocks went back to the source.
+    NO_INLINE int releaseAll (void) {
+      HL::Guard<LockType> l (_theLock);
+      Check<HoardManager, sanityCheck> check (this);
+      int released = 0;
+      for (int i = 0; i < NumBins; i++) {
+	const size_t sz = getClassSize (i);
+	SuperblockType * sbs[MaxBatch];
+	int n = 0;
+	for (;;) {
+	  SuperblockType * s = _otherBins(i).get();
+	  if (!s) {
+	    break;
+	  }
+	  decStatsSuperblock (s, i);
+	  if (s->getObjectsFree() == s->getTotalObjects()) {
+	    _sourceHeap.release (s);
+	    released++;
+	    continue;
+	  }
+	  sbs[n++] = s;
+	  if (n == MaxBatch) {
+	    _ph.putBatch (reinterpret_cast<typename ParentHeap::SuperblockType **>(sbs), n, sz);
+	    n = 0;
+	  }
+	}
+	if (n > 0) {
+	  _ph.putBatch (reinterpret_cast<typename ParentHeap::SuperblockType **>(sbs), n, sz);
+	}
+	_fetchBatch(i) = 1;
+      }
+      return released;
+    }
+
+    /// @brief Free every object on this heap at once, whether or not
+    /// anyone freed it, and give up every superblock, now empty, to the
+    /// parent heap (see hoard_arena_destroy).
+    /// @note  Nothing may touch those objects, or allocate here, again.
+    NO_INLINE void discardAll (void) {
+      HL::Guard<LockType> l (_theLock);
+      Check<HoardManager, sanityCheck> check (this);
+      for (int i = 0; i < NumBins; i++) {
+	const size_t sz = getClassSize (i);
+	SuperblockType * sbs[MaxBatch];
+	int n = 0;
+	for (;;) {
+	  SuperblockType * s = _otherBins(i).getAny();
+	  if (!s) {
+	    break;
+	  }
+	  decStatsSuperblock (s, i);
+	  s->clear();
+	  sbs[n++] = s;
+	  if (n == MaxBatch) {
+	    _ph.putBatch (reinterpret_cast<typename ParentHeap::SuperblockType **>(sbs), n, sz);
+	    n = 0;
+	  }
+	}
+	if (n > 0) {
+	  _ph.putBatch (reinterpret_cast<typename ParentHeap::SuperblockType **>(sbs), n, sz);
+	}
+	_fetchBatch(i) = 1;
+      }
+    }
+
+    /// The heap we get superblocks from, and give them back to.
+    ParentHeap& getParentHeap (void) {
+      return _ph;
+    }
+
+    /// @brief Add the bytes of this heap's superblocks, and the bytes
+    /// of the objects in use in them, to allocated and inUse.
+    NO_INLINE void getTotals (size_t& allocated, size_t& inUse) {
+      HL::Guard<LockType> l (_theLock);
+      for (int i = 0; i < NumBins; i++) {
+	const size_t sz = getClassSize (i);
+	allocated += (size_t) _stats(i).getAllocated() * sz;
+	inUse += (size_t) _stats(i).getInUse() * sz;
+      }
+    }
+
+#if HOARD_MESH
+    /// Note that sz's size class took in superblocks (see compactPending).
+    void noteCompactable (size_t sz) {
+      _compactPending(getSizeClass (sz)) = true;
+    }
+
+    /// @brief Compact (see compact) each size class noted since the
+    /// last call.
+    template <class Compactor>
+    void compactPending (Compactor& c) {
+      for (int i = 0; i < NumBins; i++) {
+	if (_compactPending(i)) {
+	  _compactPending(i) = false;
+	  compact (getClassSize (i), c);
+	}
+      }
+    }
+
+    /// @brief Hand the partially-empty superblocks of one size class
+    /// to a compactor (see mesher.h), then take back the survivors.
+    template <class Compactor>
+    NO_INLINE void compact (size_t sz, Compactor& c) {
+      HL::Guard<LockType> l (_theLock);
+      Check<HoardManager, sanityCheck> check (this);
+      const int binIndex = getSizeClass (sz);
+      SuperblockType * sbs[Compactor::MaxCandidates];
+      int n = 0;
+      while (n < Compactor::MaxCandidates) {
+	SuperblockType * s = _otherBins(binIndex).get();
+	if (!s) {
+	  break;
+	}
+	decStatsSuperblock (s, binIndex);
+	sbs[n++] = s;
+      }
+      n = c.compact (sbs, n);
+      for (int i = 0; i < n; i++) {
+	unlocked_put (sbs[i], sz);
+      }
+    }
+#endif
+
+    /// @brief Apply f to every superblock on this heap.
+    /// @note  The caller must hold the lock (see HeapManager::lock).
+    template <class Function>
+    void forEachSuperblock (Function& f) {
+      for (int i = 0; i < NumBins; i++) {
+	_otherBins(i).forEach (f);
+      }
+    }
+
     INLINE void lock (void) {
       _theLock.lock();
     }
@@ -182,10 +451,18 @@ namespace Hoard {
       _theLock.unlock();
     }
 
+    /// The calling thread is done with this heap (see BiasedLock).
+    void unbias (void) {
+      _theLock.unbias();
+    }
+
   private:
 
     typedef BaseHoardManager<SuperblockType_> SuperHeap;
 
+    /// The most superblocks we move to or from the parent in one trip.
+    enum { MaxBatch = 8 };
+
     enum { SuperblockSize = sizeof(SuperblockType_) };
 
     /// Ensure that the superblock size is a power of two.
@@ -205,36 +482,88 @@ namespace Hoard {
 
 
     /// The type of the bin manager.
-    typedef HL::bins<typename SuperblockType::Header, SuperblockSize> binType;
+    typedef SizeClasses<typename SuperblockType::Header, SuperblockSize> binType;
+
+    /// How many bins do we need to maintain? One per size class,
+    /// plus one for tiny objects.
+    enum { NumBins = binType::NUM_BINS + 1 };
+
+    /// The bin that holds tiny objects.
+    enum { TinyBin = binType::NUM_BINS };
+
+    static inline int getSizeClass (size_t sz) {
+      if (sz <= TinyObjectSize) {
+	return TinyBin;
+      }
+      return binType::getSizeClass (sz);
+    }
 
-    /// How many bins do we need to maintain?
-    enum { NumBins = binType::NUM_BINS };
+    static inline size_t getClassSize (int binIndex) {
+      if (binIndex == TinyBin) {
+	return TinyObjectSize;
+      }
+      return binType::getClassSize (binIndex);
+    }
 
     NO_INLINE void slowPathFree (int binIndex, int u, int a) {
       // We've crossed the threshold.
-      // Remove a superblock and give it to the 'parent heap.'
+      // Remove superblocks until we are back under it (up to a batch),
+      // and give them to the 'parent heap' all at once.
       Check<HoardManager, sanityCheck> check (this);
     
       //	printf ("HoardManager: this = %x, getting a superblock\n", this);
     
-      SuperblockType * sb = _otherBins(binIndex).get ();
-    
-      // We should always get one.
-      assert (sb);
-      if (sb) {
+      const size_t sz = getClassSize (binIndex);
+      SuperblockType * sbs[MaxBatch];
+      int n = 0;
+      do {
+	SuperblockType * sb = _otherBins(binIndex).get ();
+	// We should always get one.
+	assert (sb);
+	if (!sb) {
+	  break;
+	}
+	const int totalObjects = sb->getTotalObjects();
+	u -= totalObjects - sb->getObjectsFree();
+	a -= totalObjects;
+	sbs[n++] = sb;
+      } while ((n < MaxBatch) && thresholdFunctionClass::function (u, a, sz));
 
-	const size_t sz = binType::getClassSize (binIndex);
-	Statistics& stats = _stats(binIndex);
-	int totalObjects = sb->getTotalObjects();
-	stats.setInUse (u - (totalObjects - sb->getObjectsFree()));
-	stats.setAllocated (a - totalObjects);
+      Statistics& stats = _stats(binIndex);
+      stats.setInUse (u);
+      stats.setAllocated (a);
 
-	// Give it to the parent heap.
-	///////// NOTE: We change the superblock type here!
-	///////// THIS HAD BETTER BE SAFE!
-	_ph.put (reinterpret_cast<typename ParentHeap::SuperblockType *>(sb), sz);
-	assert (sb->isValidSuperblock());
+      // We brought in more than we needed: fetch fewer next time.
+      if (_fetchBatch(binIndex) > 1) {
+	_fetchBatch(binIndex) /= 2;
+      }
 
+      // Give them to the parent heap.
+      ///////// NOTE: We change the superblock type here!
+      ///////// THIS HAD BETTER BE SAFE!
+      if (n > 0) {
+	_ph.putBatch (reinterpret_cast<typename ParentHeap::SuperblockType **>(sbs), n, sz);
+      }
+    }
+
+    /// Put a superblock here, or pass it up if it puts us over the threshold.
+    void putOne (SuperblockType * s, size_t sz) {
+      assert (s->getOwner() != this);
+      Check<HoardManager, sanityCheck> check (this);
+
+      const int binIndex = getSizeClass(sz);
+
+      // Check to see whether this superblock puts us over.
+      Statistics& stats = _stats(binIndex);
+      int a = stats.getAllocated() + s->getTotalObjects();
+      int u = stats.getInUse() + (s->getTotalObjects() - s->getObjectsFree());
+
+      if (thresholdFunctionClass::function (u, a, sz)) {
+	// We've crossed the threshold function,
+	// so we move this superblock up to the parent.
+	_ph.put (reinterpret_cast<typename ParentHeap::SuperblockType *>(s), sz);
+      } else {
+	unlocked_put (s, sz);
       }
     }
 
@@ -246,10 +575,10 @@ namespace Hoard {
 
       Check<HoardManager, sanityCheck> check (this);
 
-      const int binIndex = binType::getSizeClass(sz);
+      const int binIndex = getSizeClass(sz);
 
       // Now put it on this heap.
-      s->setOwner (reinterpret_cast<HeapType *>(this));
+      s->setOwner (reinterpret_cast<HeapType *>(this), Kind);
       _otherBins(binIndex).put (s);
 
       // Update the heap statistics with the allocated and in use stats
@@ -282,8 +611,8 @@ namespace Hoard {
     }
 
     MALLOC_FUNCTION NO_INLINE void * slowPathMalloc (size_t sz) {
-      const int binIndex = binType::getSizeClass (sz);
-      size_t realSize = binType::getClassSize (binIndex);
+      const int binIndex = getSizeClass (sz);
+      size_t realSize = getClassSize (binIndex);
       assert (realSize >= sz);
       for (;;) {
 	Check<HoardManager, sanityCheck> check (this);
@@ -301,10 +630,11 @@ namespace Hoard {
       }
     }
 
-    /// Get one object of a particular size.
-    MALLOC_FUNCTION INLINE void * getObject (int binIndex, size_t sz) {
+    /// @brief Get one object of a particular size.
+    /// @param dense take it from the fullest superblock with room.
+    MALLOC_FUNCTION INLINE void * getObject (int binIndex, size_t sz, bool dense = false) {
       Check<HoardManager, sanityCheck> check (this);
-      void * ptr = _otherBins(binIndex).malloc (sz);
+      void * ptr = dense ? _otherBins(binIndex).mallocDense (sz) : _otherBins(binIndex).malloc (sz);
       if (ptr) {
 	// We got one. Update stats.
 	int u = _stats(binIndex).getInUse();
@@ -337,37 +667,71 @@ namespace Hoard {
 
       SuperblockType * sb = NULL;
 
-      // Try the parent heap.
+      // Try the parent heap, for as many superblocks as we last
+      // needed; if it had them all, we may need more next time.
       // NOTE: We change the superblock type here!
-      sb = reinterpret_cast<SuperblockType *>(_ph.get (sz, reinterpret_cast<ParentHeap *>(this)));
+      const int binIndex = getSizeClass (sz);
+      const int want = _fetchBatch(binIndex);
+      SuperblockType * sbs[MaxBatch];
+      const int n =
+	_ph.getBatch (sz, reinterpret_cast<ParentHeap *>(this),
+		      reinterpret_cast<typename ParentHeap::SuperblockType **>(sbs), want);
+      if ((n == want) && (want < MaxBatch)) {
+	_fetchBatch(binIndex) = want * 2;
+      }
 
-      if (sb) {
-	if (!sb->isValidSuperblock()) {
+      if (n > 0) {
+	for (int i = 0; i < n; i++) {
 	  // As above - drop any invalid superblocks.
-	  sb = NULL;
+	  if (sbs[i]->isValidSuperblock()) {
+	    sb = sbs[i];
+	    // Put the superblock into its appropriate bin.
+	    unlocked_put (sb, sz);
+	  }
 	}
 
       } else {
 	// Nothing - get memory from the source.
-	void * ptr = _sourceHeap.malloc (SuperblockSize);
-	if (!ptr) {
+	sb = makeSuperblock (sz, false);
+	if (!sb) {
 	  return 0;
 	}
-	sb = new (ptr) SuperblockType (sz);
-      }
-
-      // Put the superblock into its appropriate bin.
-      if (sb) {
 	unlocked_put (sb, sz);
       }
       return sb;
     }
 
+    /// @brief Build a superblock for objects of size sz from new memory.
+    /// @param populate fault its pages in now (see prewarm).
+    SuperblockType * makeSuperblock (size_t sz, bool populate) {
+      void * ptr = _sourceHeap.malloc (SuperblockSize);
+      if (!ptr) {
+	return NULL;
+      }
+      if (populate) {
+	prefault (ptr, SuperblockSize);
+      }
+      return new (ptr) SuperblockType (sz);
+    }
+
     LockType _theLock;
 
     /// Usage statistics for each bin.
     Array<NumBins, Statistics> _stats;
 
+    /// How many superblocks of each size class to ask the parent for
+    /// next time (1 up to MaxBatch), doubling while we keep running
+    /// out and halving whenever we give superblocks back.
+    Array<NumBins, int> _fetchBatch;
+
+#if HOARD_MESH
+    /// Which size classes took in superblocks since compactPending ran.
+    Array<NumBins, volatile bool> _compactPending;
+#endif
+
+    /// See getTransferTrips.
+    unsigned long _transferTrips;
+
     typedef SuperblockType * SuperblockTypePointer;
 
     typedef EmptyClass<SuperblockType, EmptinessClasses> OrganizedByEmptiness;
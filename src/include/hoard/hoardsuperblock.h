@@ -34,7 +34,9 @@
 #include "heaplayers.h"
 //#include "freesllist.h"
 
+#include "hoardconstants.h"
 #include "hoardsuperblockheader.h"
+#include "pagemap.h"
 
 namespace Hoard {
 
@@ -44,8 +46,13 @@ namespace Hoard {
   class HoardSuperblock {
   public:
 
+    // Whole-line objects start on a line, so none straddles two (see
+    // hoard_malloc_isolated). This skips at most one line's worth of
+    // header padding, which for 64K superblocks never costs a whole
+    // object in any whole-line size class.
     HoardSuperblock (size_t sz)
-      : _header (sz, BufferSize)
+      : _header (sz, BufferSize,
+		 (sz % CacheLineSize == 0) ? (size_t) CacheLineSize : (size_t) Header::Alignment)
     {
       assert (_header.isValid());
       assert (this == (HoardSuperblock *)
@@ -55,11 +62,32 @@ namespace Hoard {
     /// @brief Find the start of the superblock by bitmasking.
     /// @note  All superblocks <em>must</em> be naturally aligned, and powers of two.
     static inline HoardSuperblock * getSuperblock (void * ptr) {
-      return (HoardSuperblock *)
+      HoardSuperblock * s = (HoardSuperblock *)
 	(((size_t) ptr) & ~((size_t) SuperblockSize-1));
+#if HOARD_MESH
+      // If this superblock has been meshed into another one, its
+      // header is the other superblock's: follow it there.
+      if (s->_header.isValid()) {
+	s = (HoardSuperblock *) s->_header.getCanonical();
+      }
+#endif
+      return s;
+    }
+
+    /// @brief True iff ptr points into one of our superblocks (or the
+    /// first chunk of a large object), so that getSuperblock finds a
+    /// header. With the page map, this reads no header at all.
+    static inline bool isOwned (void * ptr) {
+#if HOARD_PAGE_MAP
+      return PageMap<SuperblockSize>::isOwned (ptr);
+#else
+      HoardSuperblock * s = getSuperblock (ptr);
+      return s && s->isValidSuperblock();
+#endif
     }
 
     INLINE size_t getSize (void * ptr) const {
+      ptr = canonicalize (ptr);
       if (_header.isValid() && inRange (ptr)) {
 	return _header.getSize (ptr);
       } else {
@@ -81,12 +109,13 @@ namespace Hoard {
       void * ptr = _header.malloc();
       if (ptr) {
 	assert (inRange (ptr));
-	assert ((size_t) ptr % HeapType::Alignment == 0);
+	assert ((size_t) ptr % _header.getAlignment() == 0);
       }
       return ptr;
     }
 
     INLINE void free (void * ptr) {
+      ptr = canonicalize (ptr);
       if (_header.isValid() && inRange (ptr)) {
 	// Pointer is in range.
 	_header.free (ptr);
@@ -129,16 +158,27 @@ namespace Hoard {
       assert (_header.isValid());
       _header.unlock();
     }
+
+    inline void resetLock (void) {
+      assert (_header.isValid());
+      _header.resetLock();
+    }
     
     inline HeapType * getOwner (void) const {
       assert (_header.isValid());
       return _header.getOwner();
     }
 
-    inline void setOwner (HeapType * o) {
+    /// @brief Get the owner and the kind of heap it is (see OwnerKind).
+    inline HeapType * getOwner (int& kind) const {
+      assert (_header.isValid());
+      return _header.getOwner (kind);
+    }
+
+    inline void setOwner (HeapType * o, int kind) {
       assert (_header.isValid());
       assert (o != NULL);
-      _header.setOwner (o);
+      _header.setOwner (o, kind);
     }
     
     inline HoardSuperblock * getNext (void) const {
@@ -171,12 +211,37 @@ namespace Hoard {
     }
     
     INLINE void * normalize (void * ptr) const {
+      ptr = canonicalize (ptr);
       void * ptr2 = _header.normalize (ptr);
       assert (inRange (ptr));
       assert (inRange (ptr2));
       return ptr2;
     }
 
+    /// @brief Translate a pointer into this superblock's own address
+    /// range (a no-op unless meshing is enabled).
+    INLINE void * canonicalize (void * ptr) const {
+#if HOARD_MESH
+      return (void *) ((size_t) this + ((size_t) ptr & ((size_t) SuperblockSize-1)));
+#else
+      return ptr;
+#endif
+    }
+
+#if HOARD_MESH
+    void getLiveMap (unsigned long long * live, int words) {
+      _header.getLiveMap (live, words);
+    }
+
+    void remesh (const unsigned long long * live) {
+      _header.remesh (live);
+    }
+
+    char * getObject (unsigned int i) const {
+      return _header.getObject (i);
+    }
+#endif
+
     typedef Hoard::HoardSuperblockHeader<LockType, SuperblockSize, HeapType> Header;
 
   private:
@@ -39,6 +39,8 @@
 #include "heaplayers.h"
 
 #include <cstdlib>
+#include <cstring>
+#include <new>
 
 #if defined(__clang__)
 #pragma clang diagnostic push
@@ -60,10 +62,18 @@ namespace Hoard {
 
     enum { Alignment = 16 };
 
+    /// @brief The size of a tiny object (see hoard_malloc_small).
+    /// @note  Tiny objects are only aligned to their own size, so that
+    /// each one costs 8 bytes rather than Alignment.
+    enum { TinyObjectSize = 8 };
+
   public:
 
     HoardSuperblockHeaderHelper (size_t sz, size_t bufferSize, char * start)
       : _magicNumber (MAGIC_NUMBER ^ (size_t) this),
+#if HOARD_MESH
+	_self (this),
+#endif
 	_objectSize (sz),
 	_objectSizeIsPowerOfTwo (!(sz & (sz - 1)) && sz),
 	_totalObjects ((unsigned int) (bufferSize / sz)),
@@ -75,9 +85,11 @@ namespace Hoard {
 	_start (start),
 	_position (start)
     {
+      sassert<(sizeof(FreeSLList::Entry) <= TinyObjectSize)> verifyTinyHoldsFreeList;
+      verifyTinyHoldsFreeList = verifyTinyHoldsFreeList;
       assert ((HL::align<Alignment>((size_t) start) == (size_t) start));
-      assert (_objectSize >= Alignment);
-      assert ((_totalObjects == 1) || (_objectSize % Alignment == 0));
+      assert ((_objectSize >= Alignment) || (_objectSize == TinyObjectSize));
+      assert ((_totalObjects == 1) || (_objectSize % getAlignment() == 0));
     }
 
     virtual ~HoardSuperblockHeaderHelper() {
@@ -87,20 +99,20 @@ namespace Hoard {
     inline void * malloc (void) {
       assert (isValid());
       void * ptr = reapAlloc();
-      assert ((ptr == NULL) || ((size_t) ptr % Alignment == 0));
+      assert ((ptr == NULL) || ((size_t) ptr % getAlignment() == 0));
       if (!ptr) {
 	ptr = freeListAlloc();
-	assert ((ptr == NULL) || ((size_t) ptr % Alignment == 0));
+	assert ((ptr == NULL) || ((size_t) ptr % getAlignment() == 0));
       }
       if (ptr != NULL) {
 	assert (getSize(ptr) >= _objectSize);
-	assert ((size_t) ptr % Alignment == 0);
+	assert ((size_t) ptr % getAlignment() == 0);
       }
       return ptr;
     }
 
     inline void free (void * ptr) {
-      assert ((size_t) ptr % Alignment == 0);
+      assert ((size_t) ptr % getAlignment() == 0);
       assert (isValid());
       _freeList.insert (reinterpret_cast<FreeSLList::Entry *>(ptr));
       _objectsFree++;
@@ -155,6 +167,11 @@ namespace Hoard {
       return _objectSize;
     }
 
+    /// The alignment of every object in this superblock.
+    size_t getAlignment (void) const {
+      return (_objectSize < Alignment) ? _objectSize : (size_t) Alignment;
+    }
+
     unsigned int getTotalObjects (void) const {
       return _totalObjects;
     }
@@ -164,17 +181,95 @@ namespace Hoard {
     }
 
     HeapType * getOwner (void) const {
-      return _owner;
+      return (HeapType *) ((size_t) _owner & ~(size_t) OwnerKindMask);
     }
 
-    void setOwner (HeapType * o) {
-      _owner = o;
+    /// @brief Get the owner and its kind (see OwnerKind) in one read,
+    /// so that the two always agree.
+    HeapType * getOwner (int& kind) const {
+      const size_t owner = (size_t) _owner;
+      kind = (int) (owner & OwnerKindMask);
+      return (HeapType *) (owner & ~(size_t) OwnerKindMask);
+    }
+
+    void setOwner (HeapType * o, int kind) {
+      assert (((size_t) o & OwnerKindMask) == 0);
+      assert ((kind & ~OwnerKindMask) == 0);
+      _owner = (HeapType *) ((size_t) o | (size_t) kind);
     }
 
     bool isValid (void) const {
+#if HOARD_MESH
+      // A meshed superblock is visible at more than one address, so
+      // we check against the address it was built at instead.
+      return (_magicNumber == (MAGIC_NUMBER ^ (size_t) _self));
+#else
       return (_magicNumber == (MAGIC_NUMBER ^ (size_t) this));
+#endif
+    }
+
+#if HOARD_MESH
+    /// @brief The address this header was built at (its canonical address).
+    const void * getCanonical (void) const {
+      return _self;
+    }
+
+    /// @brief Set one bit for every object that is not on the free
+    /// list or in the reap area (objects cached in TLABs count as live).
+    void getLiveMap (unsigned long long * live, int words) {
+      assert (isValid());
+      for (int w = 0; w < words; w++) {
+	live[w] = 0;
+      }
+      const unsigned int carved = _totalObjects - _reapableObjects;
+      for (unsigned int i = 0; i < carved; i++) {
+	live[i / 64] |= (1ULL << (i % 64));
+      }
+      // Drain the free list, clearing the bit for each entry, and then
+      // put the entries back.
+      FreeSLList entries;
+      FreeSLList::Entry * e;
+      while ((e = _freeList.get()) != NULL) {
+	const unsigned int i = getIndex (e);
+	live[i / 64] &= ~(1ULL << (i % 64));
+	entries.insert (e);
+      }
+      while ((e = entries.get()) != NULL) {
+	_freeList.insert (e);
+      }
+    }
+
+    /// @brief Rebuild the free list and counters from a live map, after
+    /// the objects of a meshed superblock have been copied in.
+    void remesh (const unsigned long long * live) {
+      assert (isValid());
+      unsigned int inUse = 0;
+      unsigned int last = 0;
+      for (unsigned int i = 0; i < _totalObjects; i++) {
+	if (live[i / 64] & (1ULL << (i % 64))) {
+	  inUse++;
+	  last = i + 1;
+	}
+      }
+      // Everything past the last live object goes back to reap mode;
+      // the holes below it go on the free list (lowest address first).
+      _freeList.clear();
+      for (unsigned int i = last; i-- > 0; ) {
+	if (!(live[i / 64] & (1ULL << (i % 64)))) {
+	  _freeList.insert (reinterpret_cast<FreeSLList::Entry *>(getObject (i)));
+	}
+      }
+      _position = getObject (last);
+      _reapableObjects = _totalObjects - last;
+      _objectsFree = _totalObjects - inUse;
     }
 
+    /// @brief Return the address of the ith object.
+    char * getObject (unsigned int i) const {
+      return const_cast<char *>(_start) + (size_t) i * _objectSize;
+    }
+#endif
+
     HoardSuperblock<LockType, SuperblockSize, HeapType> * getNext (void) const {
       return _next;
     }
@@ -199,8 +294,27 @@ namespace Hoard {
       _theLock.unlock();
     }
 
+    /// @brief Release the lock in a forked child, where whoever held
+    /// it may be gone. Leaves an unlocked lock untouched, so the child
+    /// does not end up with its own copy of every header page.
+    void resetLock (void) {
+      LockType unlocked;
+      if (memcmp (&_theLock, &unlocked, sizeof(LockType)) != 0) {
+	new (&_theLock) LockType;
+      }
+    }
+
   private:
 
+#if HOARD_MESH
+    /// @brief The index of the object at ptr, from any address it is visible at.
+    unsigned int getIndex (void * ptr) const {
+      const size_t offset = ((size_t) ptr & (SuperblockSize - 1))
+	- ((size_t) _start & (SuperblockSize - 1));
+      return (unsigned int) (offset / _objectSize);
+    }
+#endif
+
     MALLOC_FUNCTION INLINE void * reapAlloc (void) {
       assert (isValid());
       assert (_position);
@@ -210,7 +324,7 @@ namespace Hoard {
 	_position = ptr + _objectSize;
 	_reapableObjects--;
 	_objectsFree--;
-	assert ((size_t) ptr % Alignment == 0);
+	assert ((size_t) ptr % getAlignment() == 0);
 	return ptr;
       } else {
 	return NULL;
@@ -233,6 +347,11 @@ namespace Hoard {
     /// A magic number used to verify validity of this header.
     const size_t _magicNumber;
 
+#if HOARD_MESH
+    /// The address this header was built at.
+    const void * const _self;
+#endif
+
     /// The object size.
     const size_t _objectSize;
 
@@ -245,7 +364,10 @@ namespace Hoard {
     /// The lock.
     LockType _theLock;
 
-    /// The owner of this superblock.
+    /// The kind of owner lives in the low bits of its (aligned) address.
+    enum { OwnerKindMask = 3 };
+
+    /// The owner of this superblock, tagged with its kind.
     HeapType * _owner;
 
     /// The preceding superblock in a linked list.
@@ -278,8 +400,14 @@ namespace Hoard {
   class HoardSuperblockHeader : public HoardSuperblockHeaderHelper<LockType, SuperblockSize, HeapType> {
   public:
 
-    HoardSuperblockHeader (size_t sz, size_t bufferSize)
-      : HoardSuperblockHeaderHelper<LockType,SuperblockSize,HeapType> (sz, bufferSize, (char *) (this + 1))
+    /// @param startAlignment the alignment of the first object (and,
+    /// when it divides sz, of every object).
+    HoardSuperblockHeader (size_t sz, size_t bufferSize,
+			   size_t startAlignment = Parent::Alignment)
+      : HoardSuperblockHeaderHelper<LockType,SuperblockSize,HeapType>
+	(sz,
+	 bufferSize - padding (this + 1, startAlignment),
+	 (char *) (this + 1) + padding (this + 1, startAlignment))
     {
       sassert<((sizeof(HoardSuperblockHeader) % Parent::Alignment) == 0)> verifySize;
       verifySize = verifySize;
@@ -289,6 +417,11 @@ namespace Hoard {
 
     typedef HoardSuperblockHeaderHelper<LockType,SuperblockSize,HeapType> Parent;
 
+    /// The bytes to skip after the header to reach the given alignment.
+    static size_t padding (const void * start, size_t alignment) {
+      return (alignment - ((size_t) start % alignment)) % alignment;
+    }
+
     char _dummy[Parent::Alignment - (sizeof(Parent) % Parent::Alignment)];
   };
 
@@ -39,6 +39,7 @@
 #include "hoardheap.h"
 #include "heapmanager.h"
 #include "tlab.h"
+#include "tlabdonationpool.h"
 #include "hoardconstants.h"
 
 #include "heaplayers.h"
@@ -79,18 +80,241 @@ namespace Hoard {
   // right.
   //
 
-  typedef ThreadLocalAllocationBuffer<HL::bins<TheHeader, SUPERBLOCK_SIZE>::NUM_BINS,
-				      HL::bins<TheHeader, SUPERBLOCK_SIZE>::getSizeClass,
-				      HL::bins<TheHeader, SUPERBLOCK_SIZE>::getClassSize,
+  typedef ThreadLocalAllocationBuffer<SizeClasses<TheHeader, SUPERBLOCK_SIZE>::NUM_BINS,
+				      SizeClasses<TheHeader, SUPERBLOCK_SIZE>::getSizeClass,
+				      SizeClasses<TheHeader, SUPERBLOCK_SIZE>::getClassSize,
 				      LargestSmallObject,
+				      BigObjectSize, // before any thread exists
 				      MAX_MEMORY_PER_TLAB,
+				      ForeignFreeBatch,
 				      HoardHeapType::SuperblockType,
 				      SUPERBLOCK_SIZE,
 				      HoardHeapType>
   TLABBase;
-  
+
+  /// The one direct-I/O buffer pool (see libhoard.cpp).
+  IOBufferPoolType * getIOBufferPool (void);
+
+  //
+  // Each thread's TLAB also caches direct-I/O buffers.
+  //
+
+  class HoardTLAB : public TLABBase {
+  public:
+
+    HoardTLAB (HoardHeapType * parent)
+      : TLABBase (parent),
+	_ioBuffers (getIOBufferPool()),
+	_heapIndex (0),
+	_privateHeap (false),
+	_arena (NULL),
+	_arenaDepth (0),
+	_outer (NULL),
+	_outerHeap (0)
+#if HOARD_MAINTENANCE_INTERVAL
+      , _flushRequested (false),
+	_bytesLastPass (0)
+#endif
+    {}
+
+    inline void * malloc (size_t sz) {
+#if HOARD_MAINTENANCE_INTERVAL
+      flushIfIdle();
+#endif
+      if (_privateHeap && (sz <= BigObjectSize)) {
+	// Our private heap is not in the thread map (see bindHeap).
+	return TLABBase::malloc (getPrivateHeap(), sz);
+      }
+      return TLABBase::malloc (sz);
+    }
+
+    inline void * mallocTiny (void) {
+      if (_privateHeap) {
+	void * ptr = mallocTinyLocal();
+	return ptr ? ptr : getPrivateHeap().malloc (TheHeader::TinyObjectSize);
+      }
+      return TLABBase::mallocTiny();
+    }
+
+#if HOARD_MAINTENANCE_INTERVAL
+    inline void free (void * ptr) {
+      flushIfIdle();
+      TLABBase::free (ptr);
+    }
+
+    /// @brief Called by the maintenance thread once a pass (see
+    /// hoardMaintain): if we hold objects and have neither allocated
+    /// nor freed any since the last pass, or hold more than memory
+    /// pressure now allows, ask our thread to return them. Only our
+    /// own thread touches our lists, so it does the flush, on its
+    /// next call.
+    void noteIdle (void) {
+      const size_t bytes = getLocalHeapBytes();
+      if ((bytes > 0) && ((bytes == _bytesLastPass) || (bytes > localHeapThreshold()))) {
+	_flushRequested = true;
+      }
+      _bytesLastPass = bytes;
+    }
+#endif
+
+    IOBufferCache<IOBufferPoolType, 8>& getIOBuffers (void) {
+      return _ioBuffers;
+    }
+
+    void clear (void) {
+      TLABBase::clear();
+      _ioBuffers.clear();
+    }
+
+    /// @brief Remember the heap that findUnusedHeap (or bindHeap)
+    /// gave our thread, and whether it is private to it, in which
+    /// case we allocate from it ourselves. Objects of the heap we
+    /// used before are no longer local to us (see forgetLocalHeap).
+    void setHeapIndex (int heapIndex, bool isPrivate = false) {
+      _heapIndex = heapIndex;
+      _privateHeap = isPrivate;
+      forgetLocalHeap();
+    }
+
+    /// @brief Return the heap our thread was given, and forget it, so
+    /// that it is released only once (see HeapManager::releaseHeap).
+    int takeHeapIndex (void) {
+      const int heapIndex = _heapIndex;
+      _heapIndex = 0;
+      _privateHeap = false;
+      return heapIndex;
+    }
+
+    /// Our thread's private heap (see hoard_private_heap), or 0.
+    int getPrivateHeapIndex (void) const {
+      return _privateHeap ? _heapIndex : 0;
+    }
+
+    /// The heap to allocate from directly, if private (see malloc).
+    HoardHeapType::PerThreadHeap& getPrivateHeap (void) const {
+      return getParentHeap().getHeap (_heapIndex);
+    }
+
+    /// @brief Serve small objects from arena until popArena (see
+    /// hoard_arena_push).
+    /// @return false if MaxArenaDepth arenas are pushed already.
+    bool pushArena (ArenaHeap * arena) {
+      if (_arenaDepth == MaxArenaDepth) {
+	return false;
+      }
+      _outerArenas[_arenaDepth++] = _arena;
+      _arena = arena;
+      return true;
+    }
+
+    /// Go back to the arena (if any) before the last pushArena.
+    void popArena (void) {
+      if (_arenaDepth > 0) {
+	_arena = _outerArenas[--_arenaDepth];
+      }
+    }
+
+    /// The arena to allocate from, or NULL (see xxmalloc).
+    ArenaHeap * getArena (void) const {
+      return _arena;
+    }
+
+    /// @brief Note that our thread entered the allocation context we
+    /// belong to, from outer and heap outerHeap (see
+    /// hoard_context_enter), or left it if outer is NULL.
+    void setOuter (HoardTLAB * outer, int outerHeap) {
+      _outer = outer;
+      _outerHeap = outerHeap;
+    }
+
+    /// What served our thread before it entered our context, if it did.
+    HoardTLAB * getOuter (void) const {
+      return _outer;
+    }
+
+    /// The heap that served our thread before it entered our context.
+    int getOuterHeap (void) const {
+      return _outerHeap;
+    }
+
+    /// @brief Forget everything about our thread (its pushed arenas,
+    /// which may be destroyed with it, and its heap), so that we can
+    /// serve another one (see retireTLAB).
+    void forgetThread (void) {
+      _arena = NULL;
+      _arenaDepth = 0;
+      _heapIndex = 0;
+      _privateHeap = false;
+      forgetLocalHeap();
+    }
+
+  private:
+
+    enum { MaxArenaDepth = 16 };
+
+    IOBufferCache<IOBufferPoolType, 8> _ioBuffers;
+
+    /// Our thread's heap (0 if it has none of its own).
+    int _heapIndex;
+
+    /// Is that heap private to our thread (see getPrivateHeap)?
+    bool _privateHeap;
+
+    /// The innermost arena pushed, if any.
+    ArenaHeap * _arena;
+
+    /// How many arenas are pushed.
+    int _arenaDepth;
+
+    /// The arenas that pushArena covered, innermost last.
+    ArenaHeap * _outerArenas[MaxArenaDepth];
+
+    /// For a context's TLAB, the TLAB its thread used before entering.
+    HoardTLAB * _outer;
+
+    /// For a context's TLAB, the heap its thread used before entering.
+    int _outerHeap;
+
+#if HOARD_MAINTENANCE_INTERVAL
+    inline void flushIfIdle (void) {
+      if (_flushRequested) {
+	_flushRequested = false;
+	clear();
+      }
+    }
+
+    /// Set by noteIdle; our thread flushes when it next sees it.
+    volatile bool _flushRequested;
+
+    /// What getLocalHeapBytes returned at the last noteIdle.
+    size_t _bytesLastPass;
+#endif
+
+  };
+
+#if HOARD_TLAB_DONATION
+  //
+  // Exiting threads hand their TLABs on to new threads, so TLABs live
+  // in the heap rather than in thread-local storage.
+  //
+
+  typedef TLABDonationPool<HoardTLAB, HOARD_TLAB_DONATION, TheLockType>
+  TLABDonationPoolType;
+
+  /// The one pool of parked TLABs (see libhoard.cpp).
+  TLABDonationPoolType * getTLABDonationPool (void);
+
+  /// @brief A TLAB for a new thread: one that an exited thread
+  /// parked, full, if there is one, and otherwise a fresh one.
+  HoardTLAB * newTLAB (void);
+
+  /// @brief Done with an exiting thread's TLAB: park it for the next
+  /// new thread or, if the pool is full, empty and free it.
+  void retireTLAB (HoardTLAB * tlab);
+#endif
+
 }
 
-typedef Hoard::TLABBase TheCustomHeapType;
+typedef Hoard::HoardTLAB TheCustomHeapType;
 
 #endif
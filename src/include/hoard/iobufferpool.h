@@ -0,0 +1,400 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+#ifndef HOARD_IOBUFFERPOOL_H
+#define HOARD_IOBUFFERPOOL_H
+
+#include <cassert>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+#include "heaplayers.h"
+#include "geometricsizeclass.h"
+#include "hoardconstants.h"
+#include "prefault.h"
+#include "streamingcopy.h"
+
+namespace Hoard {
+
+  /**
+   * @class IOBufferPool
+   * @brief Page-aligned buffers for direct I/O that stay resident.
+   *
+   * Buffers come in power-of-two sizes from MinBuffer to MaxBuffer.
+   * Each is carved from a RegionSize-aligned region that holds buffers
+   * of one size only. Regions are prefaulted (and, with
+   * HOARD_IO_BUFFER_MLOCK, locked in memory) when mapped, and are
+   * never given back, so a buffer never faults or moves once handed
+   * out. Larger requests get regions of their own, which go back to
+   * the OS on free.
+   *
+   * The region table is read without locks; threads go through an
+   * IOBufferCache, which only takes a lock to move buffers in bulk.
+   */
+
+  template <size_t RegionSize,
+	    size_t MinBuffer,
+	    size_t MaxBuffer,
+	    int MaxRegions,
+	    class LockType,
+	    class RegionSource>
+  class IOBufferPool {
+  public:
+
+    enum { NumClasses = ilog<2, 1, MaxBuffer / MinBuffer>::VALUE + 1 };
+
+    HL::sassert<((RegionSize % MaxBuffer) == 0)> verifyRegionHoldsBuffers;
+    HL::sassert<((MinBuffer % HL::MmapWrapper::Size) == 0)> verifyPageAligned;
+
+    IOBufferPool (void)
+    {
+      // Only store into entries that are not already zero, so that a
+      // table in zero-filled static storage is never paged in.
+      for (int i = 0; i < MaxRegions; i++) {
+	if (_region[i].base != NULL) {
+	  _region[i].base = NULL;
+	}
+      }
+      for (int c = 0; c < NumClasses; c++) {
+	_free[c] = NULL;
+	_bump[c] = NULL;
+	_end[c] = NULL;
+      }
+    }
+
+    /// @brief The size class for a request of sz bytes (-1 if larger than any).
+    static int getSizeClass (size_t sz) {
+      int c = 0;
+      size_t s = MinBuffer;
+      while ((s < sz) && (c < NumClasses)) {
+	s <<= 1;
+	c++;
+      }
+      return (c < NumClasses) ? c : -1;
+    }
+
+    static size_t getClassSize (int c) {
+      return (size_t) MinBuffer << c;
+    }
+
+    /// @brief Move up to n buffers of class c into bufs.
+    /// @return how many we moved (0 if out of memory).
+    int get (int c, void ** bufs, int n) {
+      HL::Guard<LockType> g (_lock[c]);
+      int i = 0;
+      while ((i < n) && (_free[c] != NULL)) {
+	bufs[i++] = _free[c];
+	_free[c] = *((void **) _free[c]);
+      }
+      const size_t sz = getClassSize (c);
+      while (i < n) {
+	if (_bump[c] == _end[c]) {
+	  char * r = (char *) newRegion (RegionSize, c);
+	  if (r == NULL) {
+	    break;
+	  }
+	  _bump[c] = r;
+	  _end[c] = r + RegionSize;
+	}
+	bufs[i++] = _bump[c];
+	_bump[c] += sz;
+      }
+      return i;
+    }
+
+    /// Return n buffers of class c.
+    void put (int c, void ** bufs, int n) {
+      HL::Guard<LockType> g (_lock[c]);
+      for (int i = 0; i < n; i++) {
+	*((void **) bufs[i]) = _free[c];
+	_free[c] = bufs[i];
+      }
+    }
+
+    /// Allocate a buffer larger than MaxBuffer, in regions of its own.
+    void * mallocLarge (size_t sz) {
+      return newRegion (HL::align<RegionSize>(sz), -1);
+    }
+
+    void freeLarge (void * ptr) {
+      Region * r = findRegion (ptr);
+      assert ((r != NULL) && (r->sizeClass == -1));
+      {
+	HL::Guard<LockType> g (_tableLock);
+	// Readers skip deleted entries, which inserts may reuse.
+	r->base = (char *) Deleted;
+      }
+      _source.free (ptr);
+    }
+
+    /// @brief Find the class of a buffer from this pool, without locking.
+    /// @return false if the pointer is not the start of one of our buffers.
+    bool getClass (void * ptr, int& c) {
+      Region * r = findRegion (ptr);
+      if (r == NULL) {
+	return false;
+      }
+      c = r->sizeClass;
+      return (c == -1) ? (ptr == r->base)
+	: (((size_t) ptr - (size_t) r->base) % getClassSize (c) == 0);
+    }
+
+    /// The size of a buffer from this pool.
+    size_t getSize (void * ptr) {
+      Region * r = findRegion (ptr);
+      if (r == NULL) {
+	return 0;
+      }
+      return (r->sizeClass == -1) ? r->size : getClassSize (r->sizeClass);
+    }
+
+    /// Lock the pool (see xxmalloc_lock).
+    void lock (void) {
+      _tableLock.lock();
+      for (int c = 0; c < NumClasses; c++) {
+	_lock[c].lock();
+      }
+      _source.lock();
+    }
+
+    void unlock (void) {
+      _source.unlock();
+      for (int c = NumClasses - 1; c >= 0; c--) {
+	_lock[c].unlock();
+      }
+      _tableLock.unlock();
+    }
+
+  private:
+
+    /// A mapped region: either buffers of one class, or one large buffer.
+    struct Region {
+      char * volatile base;
+      size_t size;
+      int sizeClass;
+    };
+
+    /// Marks a table entry whose region is gone.
+    enum { Deleted = 1 };
+
+    static size_t hash (const void * ptr) {
+      return ((size_t) ptr / RegionSize) % MaxRegions;
+    }
+
+    /// The region holding ptr (large buffers: only their first region).
+    Region * findRegion (void * ptr) {
+      char * base = (char *) ((size_t) ptr & ~(RegionSize - 1));
+      size_t i = hash (base);
+      for (int probes = 0; probes < MaxRegions; probes++) {
+	char * b = _region[i].base;
+	if (b == base) {
+	  return &_region[i];
+	}
+	if (b == NULL) {
+	  return NULL;
+	}
+	i = (i + 1) % MaxRegions;
+      }
+      return NULL;
+    }
+
+    /// Map, prefault, and record a region of sz bytes for class c.
+    void * newRegion (size_t sz, int c) {
+      void * ptr = _source.malloc (sz);
+      if (ptr == NULL) {
+	return NULL;
+      }
+      assert ((size_t) ptr % RegionSize == 0);
+      prefault (ptr, sz);
+      HL::Guard<LockType> g (_tableLock);
+      size_t i = hash (ptr);
+      for (int probes = 0; probes < MaxRegions; probes++) {
+	char * b = _region[i].base;
+	if ((b == NULL) || (b == (char *) Deleted)) {
+	  _region[i].size = sz;
+	  _region[i].sizeClass = c;
+	  // Publish the entry last, for readers that do not lock.
+#if defined(__GNUC__)
+	  __sync_synchronize();
+#endif
+	  _region[i].base = (char *) ptr;
+	  return ptr;
+	}
+	i = (i + 1) % MaxRegions;
+      }
+      // The table is full.
+      _source.free (ptr);
+      return NULL;
+    }
+
+    /// Back the region with (huge) pages now rather than on first touch.
+    static void prefault (void * ptr, size_t sz) {
+#if defined(MADV_HUGEPAGE)
+      madvise (ptr, sz, MADV_HUGEPAGE);
+#endif
+#if HOARD_IO_BUFFER_MLOCK && !defined(_WIN32)
+      // Locking faults every page in, too.
+      if (mlock (ptr, sz) == 0) {
+	return;
+      }
+#endif
+      Hoard::prefault (ptr, sz);
+    }
+
+    /// Guards the region table (readers do not lock).
+    LockType _tableLock;
+
+    /// The regions we have mapped, hashed by address.
+    Region _region[MaxRegions];
+
+    /// One lock per class, for its free list and current region.
+    LockType _lock[NumClasses];
+
+    /// Free buffers of each class, linked through their first word.
+    void * _free[NumClasses];
+
+    /// Where the next buffer of each class comes from.
+    char * _bump[NumClasses];
+
+    /// The end of each class's current region.
+    char * _end[NumClasses];
+
+    RegionSource _source;
+
+  };
+
+
+  /**
+   * @class IOBufferCache
+   * @brief A thread's cache of buffers from an IOBufferPool.
+   *
+   * Allocation and free only touch this cache, without locking,
+   * except to move half a cache's worth of buffers to or from the
+   * pool at a time.
+   */
+
+  template <class Pool,
+	    int Slots>
+  class IOBufferCache {
+  public:
+
+    IOBufferCache (Pool * pool)
+      : _pool (pool)
+    {
+      for (int c = 0; c < Pool::NumClasses; c++) {
+	_count[c] = 0;
+      }
+    }
+
+    ~IOBufferCache (void) {
+      clear();
+    }
+
+    void * malloc (size_t sz) {
+      const int c = Pool::getSizeClass (sz);
+      if (c < 0) {
+	return _pool->mallocLarge (sz);
+      }
+      if (_count[c] == 0) {
+	_count[c] = _pool->get (c, _slots[c], Batch);
+	if (_count[c] == 0) {
+	  return NULL;
+	}
+      }
+      return _slots[c][--_count[c]];
+    }
+
+    /// Free a buffer; ignores anything that is not one of the pool's.
+    void free (void * ptr) {
+      int c;
+      if ((ptr == NULL) || !_pool->getClass (ptr, c)) {
+	return;
+      }
+      if (c < 0) {
+	_pool->freeLarge (ptr);
+	return;
+      }
+      if (_count[c] == Slots) {
+	_count[c] -= Batch;
+	_pool->put (c, &_slots[c][_count[c]], Batch);
+      }
+      _slots[c][_count[c]++] = ptr;
+    }
+
+    void * realloc (void * ptr, size_t sz) {
+      if (ptr == NULL) {
+	return malloc (sz);
+      }
+      const size_t oldSize = _pool->getSize (ptr);
+      if (oldSize == 0) {
+	return NULL;
+      }
+      if ((Pool::getSizeClass (sz) == Pool::getSizeClass (oldSize))
+	  && ((Pool::getSizeClass (sz) >= 0) || (sz <= oldSize))) {
+	// It still fits, and no smaller buffer would do.
+	return ptr;
+      }
+      void * buf = malloc (sz);
+      if (buf != NULL) {
+	// A big buffer's contents are usually bound for a device, not
+	// for our caches.
+	StreamingCopy<StreamingThreshold>::copy (buf, ptr, (oldSize < sz) ? oldSize : sz);
+	free (ptr);
+      }
+      return buf;
+    }
+
+    /// Return every cached buffer to the pool.
+    void clear (void) {
+      for (int c = 0; c < Pool::NumClasses; c++) {
+	if (_count[c] > 0) {
+	  _pool->put (c, _slots[c], _count[c]);
+	  _count[c] = 0;
+	}
+      }
+    }
+
+  private:
+
+    /// How many buffers move between this cache and the pool at once.
+    enum { Batch = (Slots + 1) / 2 };
+
+    Pool * _pool;
+
+    int _count[Pool::NumClasses];
+
+    void * _slots[Pool::NumClasses][Slots];
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+
+  Copyright (c) 1998-2012 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_MESHER_H
+#define HOARD_MESHER_H
+
+#include <string.h>
+
+#include "heaplayers.h"
+
+namespace Hoard {
+
+  /**
+   * @class Mesher
+   * @brief Compacts sparsely-used superblocks of one size class
+   * without moving objects, in the style of Mesh (PLDI 2019).
+   *
+   * Two superblocks "mesh" when no object slot is live in both. The
+   * live objects of one (drop) are copied to the same offsets in the
+   * other (keep), and the arena then maps drop's address range onto
+   * keep's physical memory. Pointers into drop stay valid; drop's
+   * physical superblock is released.
+   *
+   * The caller (HoardManager::compact) must hold the owning heap's
+   * lock, so that no object in these superblocks can be freed or
+   * allocated while we work.
+   */
+
+  template <class SuperblockType,
+	    class Arena>
+  class Mesher {
+  public:
+
+    /// The most superblocks considered at once.
+    enum { MaxCandidates = 64 };
+
+    /// @brief Mesh what we can among sbs[0..n), compacting the array
+    /// to the superblocks that survive; returns how many that is.
+    int compact (SuperblockType ** sbs, int n) {
+      if (!_arena.canMesh()) {
+	return n;
+      }
+      bool gone[MaxCandidates];
+      int live[MaxCandidates];
+      for (int i = 0; i < n; i++) {
+	sbs[i]->getLiveMap (_live[i], MapWords);
+	live[i] = sbs[i]->getTotalObjects() - sbs[i]->getObjectsFree();
+	gone[i] = false;
+      }
+      for (int i = 0; i < n; i++) {
+	if (gone[i] || !isCandidate (sbs[i], live[i])) {
+	  continue;
+	}
+	for (int j = i + 1; j < n; j++) {
+	  if (gone[j] || !isCandidate (sbs[j], live[j]) || !disjoint (i, j)) {
+	    continue;
+	  }
+	  // Copy the sparser superblock into the denser one, as long as
+	  // nothing else has already been meshed onto the one we drop.
+	  int keep = i, drop = j;
+	  if ((live[i] < live[j]) && !_arena.isAliased (sbs[i])) {
+	    keep = j;
+	    drop = i;
+	  }
+	  if (_arena.isAliased (sbs[drop])) {
+	    continue;
+	  }
+	  if (!meshPair (keep, drop, sbs)) {
+	    // The arena refuses to mesh after all (see beginMesh).
+	    return n;
+	  }
+	  live[keep] += live[drop];
+	  gone[drop] = true;
+	  if (drop == i) {
+	    break;
+	  }
+	}
+      }
+      int survivors = 0;
+      for (int i = 0; i < n; i++) {
+	if (!gone[i]) {
+	  sbs[survivors++] = sbs[i];
+	}
+      }
+      return survivors;
+    }
+
+  private:
+
+    /// Enough bits for one per object in the fullest possible superblock.
+    enum { MapWords = (sizeof(SuperblockType) / SuperblockType::Header::TinyObjectSize + 63) / 64 };
+
+    /// Only partially-used superblocks with more than one slot, that
+    /// the arena maps from its file, can mesh.
+    bool isCandidate (SuperblockType * s, int live) {
+      return (live > 0) && (live < s->getTotalObjects()) && (s->getTotalObjects() > 1)
+	&& _arena.isShared (s);
+    }
+
+    bool disjoint (int i, int j) const {
+      for (int w = 0; w < MapWords; w++) {
+	if (_live[i][w] & _live[j][w]) {
+	  return false;
+	}
+      }
+      return true;
+    }
+
+    /// @brief Mesh sbs[drop] into sbs[keep]; false if the arena refused.
+    bool meshPair (int keep, int drop, SuperblockType ** sbs) {
+      SuperblockType * k = sbs[keep];
+      SuperblockType * d = sbs[drop];
+      const size_t objectSize = k->getObjectSize();
+      const unsigned int total = (unsigned int) k->getTotalObjects();
+      // Read drop through the view the arena gives us: drop itself is
+      // write-protected until endMesh.
+      const char * view = (const char *) _arena.beginMesh (d);
+      if (view == NULL) {
+	return false;
+      }
+      for (unsigned int i = 0; i < total; i++) {
+	if (_live[drop][i / 64] & (1ULL << (i % 64))) {
+	  const size_t offset = (size_t) d->getObject (i) - (size_t) d;
+	  memcpy (k->getObject (i), view + offset, objectSize);
+	}
+      }
+      for (int w = 0; w < MapWords; w++) {
+	_live[keep][w] |= _live[drop][w];
+      }
+      k->remesh (_live[keep]);
+      _arena.endMesh (k, d);
+      return true;
+    }
+
+    /// The live map of each candidate.
+    unsigned long long _live[MaxCandidates][MapWords];
+
+    Arena _arena;
+
+  };
+
+}
+
+#endif
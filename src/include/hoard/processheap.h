@@ -36,6 +36,10 @@
 #include "hoardmanager.h"
 #include "hoardsuperblock.h"
 
+#if HOARD_MESH
+#include "mesher.h"
+#endif
+
 namespace Hoard {
 
   template <size_t SuperblockSize,
@@ -51,17 +55,56 @@ namespace Hoard {
 		 EmptinessClasses,
 		 LockType,
 		 ThresholdClass,
-		 ProcessHeap<SuperblockSize, EmptinessClasses, LockType, ThresholdClass, MmapSource> > > {
+		 ProcessHeap<SuperblockSize, EmptinessClasses, LockType, ThresholdClass, MmapSource>,
+		 GlobalHeapOwner> > {
   
   public:
   
-    ProcessHeap (void) {}
+    ProcessHeap (void)
+    {}
     
     // Disable allocation from this heap.
     inline void * malloc (size_t);
 
+    typedef HoardSuperblock<LockType, SuperblockSize, ProcessHeap> SuperblockType;
+
+    /// @brief Nothing allocates from superblocks here, so any object
+    /// still in one is worth moving to a thread's heap (see
+    /// hoard_defrag_hint).
+    bool isSparse (SuperblockType *) {
+      return true;
+    }
+
+#if HOARD_MESH
+    typedef typename ProcessHeap::SuperHeap SuperHeap;
+
+    /// Put a superblock on this heap, and note its size class for mesh.
+    void put (SuperblockType * s, size_t sz) {
+      SuperHeap::put (s, sz);
+      SuperHeap::noteCompactable (sz);
+    }
+
+    /// Put n superblocks on this heap, as put does.
+    void putBatch (SuperblockType ** sbs, int n, size_t sz) {
+      SuperHeap::putBatch (sbs, n, sz);
+      SuperHeap::noteCompactable (sz);
+    }
+
+    /// @brief Try to mesh each size class that took in superblocks
+    /// since the last call. This holds each class's lock while it
+    /// copies objects, so only the maintenance thread calls it (see
+    /// hoardMaintain), never a malloc or free.
+    void mesh (void) {
+      SuperHeap::compactPending (_mesher);
+    }
+#endif
+
   private:
 
+#if HOARD_MESH
+    Mesher<SuperblockType, MmapSource> _mesher;
+#endif
+
     // Prevent copying or assignment.
     ProcessHeap (const ProcessHeap&);
     ProcessHeap& operator=(const ProcessHeap&);
@@ -29,6 +29,10 @@
 #define HOARD_REDIRECTFREE_H
 
 #include "heaplayers.h"
+#include "basehoardmanager.h"
+
+// Set once the first thread is created (see libhoard.cpp).
+extern volatile bool anyThreadCreated;
 
 namespace Hoard {
 
@@ -36,10 +40,19 @@ namespace Hoard {
    * @class RedirectFree
    * @brief Routes free calls to the Superblock's owner heap.
    * @note  We also lock the heap on calls to malloc.
+   *
+   * An owner is a thread's heap (ThreadOwner), the global heap
+   * (GlobalOwner) or an arena (ArenaOwner), as its superblocks record
+   * (see OwnerKind), so
+   * we call it directly rather than through BaseHoardManager's virtual
+   * methods, and its lock and free inline here.
    */
 
   template <class Heap,
-	    typename SuperblockType_>
+	    typename SuperblockType_,
+	    class ThreadOwner,
+	    class GlobalOwner,
+	    class ArenaOwner>
   class RedirectFree {
   public:
 
@@ -54,15 +67,20 @@ namespace Hoard {
     inline void * malloc (size_t sz) {
       void * ptr = _theHeap.malloc (sz);
       assert (getSize(ptr) >= sz);
-      assert ((size_t) ptr % Alignment == 0);
+      assert ((sz < Alignment) || ((size_t) ptr % Alignment == 0));
       return ptr;
     }
 
-    size_t getSize (void * ptr) {
+    /// Allocate from the fullest superblock with room (see HoardManager).
+    inline void * mallocDense (size_t sz) {
+      return _theHeap.mallocDense (sz);
+    }
+
+    static size_t getSize (void * ptr) {
       return Heap::getSize (ptr);
     }
 
-    SuperblockType * getSuperblock (void * ptr) {
+    static SuperblockType * getSuperblock (void * ptr) {
       return Heap::getSuperblock (ptr);
     }
 
@@ -75,8 +93,24 @@ namespace Hoard {
 
       // Find out who the owner is.
 
-      typedef BaseHoardManager<SuperblockType> * baseHeapType;
-      baseHeapType owner;
+      int kind;
+      void * owner;
+
+      if (!anyThreadCreated) {
+	// Sequential mode: with only one thread, no one can move the
+	// superblock or touch its owner while we free, so skip the
+	// locking protocol below. Nothing is held across the switch to
+	// threaded mode, which happens inside pthread_create.
+	owner = s->getOwner (kind);
+	if (kind == GlobalHeapOwner) {
+	  ownerFree (static_cast<GlobalOwner *>(owner), ptr);
+	} else if (kind == ArenaHeapOwner) {
+	  ownerFree (static_cast<ArenaOwner *>(owner), ptr);
+	} else {
+	  ownerFree (static_cast<ThreadOwner *>(owner), ptr);
+	}
+	return;
+      }
 
       s->lock();
 
@@ -87,27 +121,155 @@ namespace Hoard {
       // (It should generally take no more than two iterations.)
 
       for (;;) {
-	owner = reinterpret_cast<baseHeapType>(s->getOwner());
-	assert (owner != NULL);
-	assert (owner->isValid());
-	// Lock the owner. If ownership changed between these two lines,
-	// we'll detect it and try again.
-	owner->lock();
-	if (owner == reinterpret_cast<baseHeapType>(s->getOwner())) {
-	  owner->free (ptr);
-	  owner->unlock();
+	owner = s->getOwner (kind);
+	bool freed;
+	if (kind == GlobalHeapOwner) {
+	  freed = freeIfOwner (s, static_cast<GlobalOwner *>(owner), ptr);
+	} else if (kind == ArenaHeapOwner) {
+	  freed = freeIfOwner (s, static_cast<ArenaOwner *>(owner), ptr);
+	} else {
+	  freed = freeIfOwner (s, static_cast<ThreadOwner *>(owner), ptr);
+	}
+	if (freed) {
 	  s->unlock();
 	  return;
 	}
-	owner->unlock();
 
 	// Sleep a little.
 	HL::Fred::yield();
       }
     }
 
+    /// @brief Free a batch of objects, locking each owner once for
+    /// all of its objects rather than once per object.
+    /// @note  Reorders ptrs.
+    static void freeBatch (void ** ptrs, unsigned int n) {
+      if (!anyThreadCreated) {
+	for (unsigned int i = 0; i < n; i++) {
+	  free (ptrs[i]);
+	}
+	return;
+      }
+
+      while (n > 0) {
+	int kind;
+	void * owner = Heap::getSuperblock (ptrs[0])->getOwner (kind);
+	if (kind == GlobalHeapOwner) {
+	  n = freeOwned (static_cast<GlobalOwner *>(owner), ptrs, n);
+	} else if (kind == ArenaHeapOwner) {
+	  n = freeOwned (static_cast<ArenaOwner *>(owner), ptrs, n);
+	} else {
+	  n = freeOwned (static_cast<ThreadOwner *>(owner), ptrs, n);
+	}
+      }
+    }
+
+    /// @brief Is ptr's superblock worth moving objects out of (see
+    /// HoardManager::isSparse)? Asks its owner, whose kind we know.
+    /// @note  Reads without locking, so the answer is only a hint.
+    static bool isSparse (void * ptr) {
+      SuperblockType * s = reinterpret_cast<SuperblockType *>(Heap::getSuperblock (ptr));
+      int kind;
+      void * owner = s->getOwner (kind);
+      if (owner == NULL) {
+	return false;
+      }
+      if (kind == GlobalHeapOwner) {
+	return ownerIsSparse (static_cast<GlobalOwner *>(owner), s);
+      } else if (kind == ArenaHeapOwner) {
+	return ownerIsSparse (static_cast<ArenaOwner *>(owner), s);
+      } else {
+	return ownerIsSparse (static_cast<ThreadOwner *>(owner), s);
+      }
+    }
+
+    /// Lock the heap (see HeapManager::lock).
+    void lock (void) {
+      _theHeap.lock();
+    }
+
+    void unlock (void) {
+      _theHeap.unlock();
+    }
+
+    /// The calling thread is done with this heap (see HeapManager::releaseHeap).
+    void unbias (void) {
+      _theHeap.unbias();
+    }
+
+    /// Give up every superblock (see HoardManager::releaseAll).
+    int releaseAll (void) {
+      return _theHeap.releaseAll();
+    }
+
+    /// Add n prefaulted superblocks of sz's size class (see HoardManager).
+    bool prewarm (size_t sz, int n) {
+      return _theHeap.prewarm (sz, n);
+    }
+
+    /// Add up this heap's superblock and in-use bytes (see HoardManager).
+    void getTotals (size_t& allocated, size_t& inUse) {
+      _theHeap.getTotals (allocated, inUse);
+    }
+
+    template <class Function>
+    void forEachSuperblock (Function& f) {
+      _theHeap.forEachSuperblock (f);
+    }
+
   private:
 
+    /// Free ptr to owner, which we hold the lock of (or need not).
+    template <class Owner>
+    static inline void ownerFree (Owner * owner, void * ptr) {
+      assert (owner != NULL);
+      owner->Owner::free (ptr);
+    }
+
+    /// Ask owner whether s is sparse, as its own kind of superblock.
+    template <class Owner>
+    static inline bool ownerIsSparse (Owner * owner, SuperblockType * s) {
+      return owner->Owner::isSparse (reinterpret_cast<typename Owner::SuperblockType *>(s));
+    }
+
+    /// @brief Lock owner, and free ptr there if it still owns s.
+    /// @return false if ownership changed before we got the lock.
+    template <class Owner>
+    static inline bool freeIfOwner (SuperblockType * s, Owner * owner, void * ptr) {
+      // Lock the owner. If ownership changed in the meantime, we'll
+      // detect it and try again.
+      owner->Owner::lock();
+      const bool owns = ((void *) s->getOwner() == (void *) owner);
+      if (owns) {
+	ownerFree (owner, ptr);
+      }
+      owner->Owner::unlock();
+      return owns;
+    }
+
+    /// @brief Free every object in ptrs that owner holds.
+    /// @return how many are left, moved to the front of ptrs.
+    template <class Owner>
+    static unsigned int freeOwned (Owner * owner, void ** ptrs, unsigned int n) {
+      owner->Owner::lock();
+      // A superblock only leaves a heap under that heap's lock, so
+      // every object we find owned by it now stays there until we
+      // unlock. Keep the rest for another round.
+      unsigned int remaining = 0;
+      for (unsigned int i = 0; i < n; i++) {
+	SuperblockType * s =
+	  reinterpret_cast<SuperblockType *>(Heap::getSuperblock (ptrs[i]));
+	assert (s->isValidSuperblock());
+	if ((void *) s->getOwner() == (void *) owner) {
+	  ownerFree (owner, ptrs[i]);
+	} else {
+	  ptrs[remaining++] = ptrs[i];
+	}
+      }
+      owner->Owner::unlock();
+      return remaining;
+    }
+
     Heap _theHeap;
 
   };
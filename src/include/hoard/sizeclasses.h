@@ -0,0 +1,63 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+#ifndef HOARD_SIZECLASSES_H
+#define HOARD_SIZECLASSES_H
+
+#include "heaplayers.h"
+
+#if HOARD_PROFILED_SIZE_CLASSES
+// Generated from a size histogram by tools/mksizeclasses.
+#include "profiledsizeclasses.h"
+#endif
+
+namespace Hoard {
+
+  /**
+   * @class SizeClasses
+   * @brief The size classes for small objects, in superblocks with the
+   * given header and size.
+   *
+   * These are Heap Layers' bins, unless Hoard is built with
+   * HOARD_PROFILED_SIZE_CLASSES, in which case they are the classes
+   * that tools/mksizeclasses generated for a recorded workload.
+   */
+
+  template <class Header,
+	    int SuperblockSize>
+  class SizeClasses :
+#if HOARD_PROFILED_SIZE_CLASSES
+    public ProfiledSizeClasses
+#else
+    public HL::bins<Header, SuperblockSize>
+#endif
+  {};
+
+}
+
+#endif
@@ -24,7 +24,9 @@ namespace Hoard {
       : _currLive (0),
 	_maxLive (0),
 	_maxFraction (1.0 + (double) ThresholdFraction / 100.0),
-	_cleared (false)
+	_slop (ThresholdSlop),
+	_cleared (false),
+	_reusedSinceDecay (false)
     {}
 
     size_t getSize (void * ptr) {
@@ -47,6 +49,7 @@ namespace Hoard {
 	if (ptr == NULL) {
 	  return BigHeap::malloc (maxSz);
 	}
+	_reusedSinceDecay = true;
 	assert (getSize(ptr) <= maxSz);
 	_currLive += getSize (ptr);
 	if (_currLive >= _maxLive) {
@@ -74,9 +77,11 @@ namespace Hoard {
       } else {
 	_currLive -= sz;
       }
+      // Whoever gets it next gets it used.
+      BigHeap::markUsed (ptr);
       _heap[cl].free (ptr);
       bool crossedThreshold = (double) _maxLive > _maxFraction * (double) _currLive;
-      if ((_currLive > ThresholdSlop) && crossedThreshold && !_cleared)
+      if ((_currLive > _slop) && crossedThreshold && !_cleared)
 	{
 	  // When we drop below the threshold, clear the heap.
 	  for (int i = 0; i < NumBins; i++) {
@@ -88,6 +93,25 @@ namespace Hoard {
 	}
     }
 
+    /// @brief Dump everything cached here unless some of it was
+    /// reused since the last call, so that cached memory nobody asks
+    /// for goes back within two calls (see hoardMaintain). Under
+    /// memory pressure (see MemoryPressure), dump it regardless, and
+    /// allow a quarter as much waste for each level of pressure.
+    /// @note The caller must hold the lock.
+    void decay (int pressure) {
+      _maxFraction = 1.0 + (double) (ThresholdFraction >> (2 * pressure)) / 100.0;
+      _slop = ThresholdSlop >> (2 * pressure);
+      if (!_reusedSinceDecay || (pressure > 0)) {
+	for (int i = 0; i < NumBins; i++) {
+	  _heap[i].clear();
+	}
+	_cleared = true;
+	_maxLive = _currLive;
+      }
+      _reusedSinceDecay = false;
+    }
+
   private:
 
     /// The current amount of live memory held by a client of this heap.
@@ -97,11 +121,17 @@ namespace Hoard {
     unsigned long _maxLive;
 
     /// Maximum fraction calculation.
-    const double _maxFraction;
+    double _maxFraction;
+
+    /// At least this much live memory before we clear (see decay).
+    unsigned long _slop;
 
     /// Have we already cleared out the superheap?
     bool _cleared;
 
+    /// Has malloc reused cached memory since the last decay?
+    bool _reusedSinceDecay;
+
     LittleHeap _heap[NumBins];
   };
 
@@ -0,0 +1,108 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+#ifndef HOARD_TLABDONATIONPOOL_H
+#define HOARD_TLABDONATIONPOOL_H
+
+#include <cstddef>
+
+#include "heaplayers.h"
+
+namespace Hoard {
+
+  /**
+   * @class TLABDonationPool
+   * @brief TLABs that exiting threads left behind, with everything
+   * they hold, for new threads to adopt.
+   *
+   * A thread that exits parks its TLAB here instead of freeing each
+   * cached object back to its heap, and the next thread to start
+   * takes it over, cache and all. Both are just a pointer moved in or
+   * out of the pool. At most Capacity TLABs wait here, each holding
+   * no more than a TLAB may, so the memory parked is bounded.
+   */
+
+  template <class TLABType,
+	    int Capacity,
+	    class LockType>
+  class TLABDonationPool {
+  public:
+
+    TLABDonationPool (void)
+      : _count (0)
+    {}
+
+    /// @brief Park a TLAB.
+    /// @return false if the pool is full (the caller keeps the TLAB).
+    bool donate (TLABType * tlab) {
+      HL::Guard<LockType> g (_lock);
+      if (_count == Capacity) {
+	return false;
+      }
+      _parked[_count++] = tlab;
+      return true;
+    }
+
+    /// @brief Take a parked TLAB, if there is one.
+    /// @return the TLAB, or NULL if the pool is empty.
+    TLABType * adopt (void) {
+      if (_count == 0) {
+	// Most threads start with nothing parked: skip the lock.
+	return NULL;
+      }
+      HL::Guard<LockType> g (_lock);
+      if (_count == 0) {
+	return NULL;
+      }
+      return _parked[--_count];
+    }
+
+    /// Lock the pool (see xxmalloc_lock).
+    void lock (void) {
+      _lock.lock();
+    }
+
+    void unlock (void) {
+      _lock.unlock();
+    }
+
+  private:
+
+    LockType _lock;
+
+    /// The number of TLABs parked.
+    volatile int _count;
+
+    /// The parked TLABs, most recently parked last.
+    TLABType * _parked[Capacity];
+
+  };
+
+}
+
+#endif
@@ -29,6 +29,7 @@
 #define HOARD_ADDHEADERHEAP_H
 
 #include "heaplayers.h"
+#include "hoardconstants.h"
 
 namespace Hoard {
 
@@ -47,9 +48,16 @@ namespace Hoard {
 
     SuperHeap theHeap;
 
+    typedef typename SuperblockType::Header Header;
+
+    // The header is padded to whole cache lines, so every object
+    // starts on a line of its own. The last word of the padding says
+    // whether the object is fresh (see isFresh).
+    enum { HeaderSize = ((sizeof(Header) + sizeof(size_t) + CacheLineSize - 1) / CacheLineSize) * CacheLineSize };
+
   public:
 
-    enum { Alignment = gcd<SuperHeap::Alignment, sizeof(typename SuperblockType::Header)>::value };
+    enum { Alignment = gcd<SuperHeap::Alignment, HeaderSize>::value };
 
     void clear() {
       theHeap.clear();
@@ -60,30 +68,49 @@ namespace Hoard {
       // Allocate extra space for the header,
       // put it at the front of the object,
       // and return a pointer to just past it.
-      const size_t headerSize = sizeof(typename SuperblockType::Header);
-      void * ptr = theHeap.malloc (sz + headerSize);
+      void * ptr = theHeap.malloc (sz + HeaderSize);
       if (ptr == NULL) {
 	return NULL;
       }
-      typename SuperblockType::Header * p
-	= new (ptr) typename SuperblockType::Header (sz, sz);
-      assert ((size_t) (p + 1) == (size_t) ptr + headerSize);
-      return reinterpret_cast<void *>(p + 1);
+      Header * p = new (ptr) Header (sz, sz + HeaderSize - sizeof(Header), CacheLineSize);
+      assert ((size_t) p->normalize ((char *) ptr + HeaderSize) == (size_t) ptr + HeaderSize);
+      void * obj = (void *) ((char *) p + HeaderSize);
+      fresh (obj) = 1;
+      return obj;
+    }
+
+    /// @brief Is this object's memory just as the source heap gave it
+    /// (for mmap, all zeroes)? True until it is first freed to a heap
+    /// that hands it out again (see markUsed).
+    INLINE static bool isFresh (void * ptr) {
+      return fresh (ptr) != 0;
+    }
+
+    /// Note that an object may have been written, before it is handed
+    /// out again (see ThresholdSegHeap).
+    INLINE static void markUsed (void * ptr) {
+      fresh (ptr) = 0;
     }
 
     INLINE static size_t getSize (void * ptr) {
       // Find the header (just before the pointer) and return the size
       // value stored there.
-      typename SuperblockType::Header * p;
-      p = reinterpret_cast<typename SuperblockType::Header *>(ptr);
-      return (p - 1)->getSize (ptr);
+      return header (ptr)->getSize (ptr);
     }
 
     INLINE void free (void * ptr) {
       // Find the header (just before the pointer) and free the whole object.
-      typename SuperblockType::Header * p;
-      p = reinterpret_cast<typename SuperblockType::Header *>(ptr);
-      theHeap.free (reinterpret_cast<void *>(p - 1));
+      theHeap.free (reinterpret_cast<void *>(header (ptr)));
+    }
+
+  private:
+
+    INLINE static Header * header (void * ptr) {
+      return reinterpret_cast<Header *>((char *) ptr - HeaderSize);
+    }
+
+    INLINE static size_t& fresh (void * ptr) {
+      return reinterpret_cast<size_t *>(ptr)[-1];
     }
   };
 
@@ -63,6 +63,12 @@ namespace Hoard {
       _freeSuperblocks.insert ((DLList::Entry *) ptr);
     }
 
+    /// @brief Return a superblock's memory to the source for good,
+    /// rather than keeping it for reuse (see HoardManager::releaseEmpty).
+    void release (void * ptr) {
+      _superblockSource.free (ptr);
+    }
+
   private:
 
 #if defined(__SVR4)
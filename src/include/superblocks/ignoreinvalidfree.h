@@ -41,8 +41,7 @@ namespace Hoard {
   public:
     INLINE void free (void * ptr) {
       if (ptr) {
-	typename SuperHeap::SuperblockType * s = SuperHeap::getSuperblock (ptr);
-	if (!s || (!s->isValidSuperblock())) {
+	if (!SuperHeap::SuperblockType::isOwned (ptr)) {
 	  // We encountered an invalid free, so we drop it.
 	  return;
 	}
@@ -52,8 +51,7 @@ namespace Hoard {
 
     INLINE size_t getSize (void * ptr) {
       if (ptr) {
-	typename SuperHeap::SuperblockType * s = SuperHeap::getSuperblock (ptr);
-	if (!s || (!s->isValidSuperblock())) {
+	if (!SuperHeap::SuperblockType::isOwned (ptr)) {
 	  return 0;
 	}
 	return SuperHeap::getSize (ptr);
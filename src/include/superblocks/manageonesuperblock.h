@@ -65,6 +65,26 @@ namespace Hoard {
       return slowMallocPath (sz);
     }
 
+    /// @brief Make the fullest superblock with room the current one,
+    /// and get memory from it.
+    /// @return NULL if no superblock we hold has room.
+    inline void * mallocDense (size_t sz) {
+      if (_current) {
+	// Let the current superblock compete with the rest.
+	SuperHeap::put (_current);
+      }
+      _current = SuperHeap::getFullest();
+      if (!_current) {
+	return NULL;
+      }
+      return _current->malloc (sz);
+    }
+
+    /// Is s the superblock we are allocating from?
+    inline bool isCurrent (SuperblockType * s) const {
+      return (s == _current);
+    }
+
     /// Try to free the pointer to this superblock first.
     inline void free (void * ptr) {
       SuperblockType * s = SuperHeap::getSuperblock (ptr);
@@ -88,6 +108,16 @@ namespace Hoard {
       }
     }
 
+    /// Get any superblock, the current one first (see EmptyClass::getAny).
+    SuperblockType * getAny (void) {
+      if (_current) {
+	SuperblockType * s = _current;
+	_current = NULL;
+	return s;
+      }
+      return SuperHeap::getAny();
+    }
+
     /// Put the superblock into the cache.
     inline void put (SuperblockType * s) {
       if (!s || (s == _current) || (!s->isValidSuperblock())) {
@@ -102,6 +132,15 @@ namespace Hoard {
       _current = s;
     }
 
+    /// Apply f to every superblock we hold, the current one included.
+    template <class Function>
+    void forEach (Function& f) {
+      if (_current) {
+	f (_current);
+      }
+      SuperHeap::forEach (f);
+    }
+
   private:
 
     /// Obtain a superblock and return an object from it.
@@ -36,6 +36,15 @@
 #define HOARD_TLAB_H
 
 #include "heaplayers.h"
+#include "basehoardmanager.h"
+
+// Set once the first thread is created (see libhoard.cpp).
+extern volatile bool anyThreadCreated;
+
+#if HOARD_MEMORY_PRESSURE
+// The level of memory pressure (see libhoard.cpp).
+extern volatile int hoardMemoryPressure;
+#endif
 
 #if defined(__clang__)
 #pragma clang diagnostic push
@@ -48,7 +57,9 @@ namespace Hoard {
 	    unsigned int (*getSizeClass) (size_t),
 	    size_t (*getClassSize) (const unsigned int),
 	    unsigned int LargestObject,
+	    unsigned int LargestSequentialObject,
 	    unsigned int LocalHeapThreshold,
+	    unsigned int ForeignFreeBatch,
 	    class SuperblockType,
 	    unsigned int SuperblockSize,
 	    class ParentHeap>
@@ -63,9 +74,11 @@ namespace Hoard {
 
     ThreadLocalAllocationBuffer (ParentHeap * parent)
       : _parentHeap (parent),
-      	_localHeapBytes (0)
+      	_localHeapBytes (0),
+	_localOwner (NULL),
+	_foreignCount (0)
     {
-      sassert<gcd<Alignment, DesiredAlignment>::value == DesiredAlignment> verifyAlignment;
+      sassert<(size_t) gcd<Alignment, DesiredAlignment>::value == (size_t) DesiredAlignment> verifyAlignment;
       sassert<(Alignment >= 2 * sizeof(size_t))> verifyCanHoldTwoPointers;
       verifyAlignment = verifyAlignment;
       verifyCanHoldTwoPointers = verifyCanHoldTwoPointers;
@@ -76,16 +89,26 @@ namespace Hoard {
     }
 
     inline static size_t getSize (void * ptr) {
+      if (!SuperblockType::isOwned (ptr)) {
+	return 0;
+      }
       return getSuperblock(ptr)->getSize (ptr);
     }
 
     inline void * malloc (size_t sz) {
+      return malloc (*_parentHeap, sz);
+    }
+
+    /// @brief Allocate from our own lists, or else from heap: our
+    /// parent, or one of the heaps it manages.
+    template <class Heap>
+    inline void * malloc (Heap& heap, size_t sz) {
       if (sz < Alignment) {
       	sz = Alignment;
       }
       // Get memory from the local heap,
       // and deduct that amount from the local heap bytes counter.
-      if (sz <= LargestObject) {
+      if (sz <= largestObject()) {
       	unsigned int c = getSizeClass (sz);
       	void * ptr = _localHeap(c).get();
       	if (ptr) {
@@ -99,32 +122,61 @@ namespace Hoard {
 
       // No more local memory (for this size, at least).
       // Now get the memory from our parent.
-      void * ptr = _parentHeap->malloc (sz);
+      void * ptr = heap.malloc (sz);
       assert ((size_t) ptr % Alignment == 0);
+      if ((ForeignFreeBatch > 0) && ptr && (sz <= largestObject())) {
+	// Small objects from our parent come from this thread's heap,
+	// so remember which heap that is (see isLocal).
+	_localOwner = getSuperblock(ptr)->getOwner();
+      }
       return ptr;
     }
 
 
+    /// @brief Allocate a tiny object, aligned only to its own size.
+    inline void * mallocTiny (void) {
+      void * ptr = mallocTinyLocal();
+      return ptr ? ptr : _parentHeap->mallocTiny();
+    }
+
     inline void free (void * ptr) {
       if (!ptr) {
 	return;
       }
-      const SuperblockType * s = getSuperblock (ptr);
       // If this isn't a valid superblock, just return.
 
-      if (s->isValidSuperblock()) {
+      if (SuperblockType::isOwned (ptr)) {
 
+	const SuperblockType * s = getSuperblock (ptr);
       	ptr = s->normalize (ptr);
       	const size_t sz = s->getObjectSize ();
 
-      	if ((sz <= LargestObject) && (sz + _localHeapBytes <= LocalHeapThreshold)) {
+	if (!isLocal (s) && isArena (s)) {
+	  // An arena can throw away its objects at any time (see
+	  // hoard_arena_destroy), so neither cache nor queue this one.
+	  _parentHeap->free (ptr);
+
+	} else if ((ForeignFreeBatch > 0) && (sz <= largestObject()) && !isLocal (s)) {
+	  // Another heap owns this object. Caching it here would hand
+	  // its cache lines to a different thread (false sharing) and
+	  // drift memory away from its owner, so send it back instead.
+	  freeForeign (ptr);
+
+	} else if ((sz <= largestObject()) && (sz + _localHeapBytes <= localHeapThreshold())) {
       	  // Free small objects locally, unless we are out of space.
 
       	  assert (getSize(ptr) >= sizeof(HL::SLList::Entry *));
-      	  unsigned int c = getSizeClass (sz);
-
-      	  _localHeap(c).insert ((HL::SLList::Entry *) ptr);
-      	  _localHeapBytes += getClassSize(c); // sz;
+	  if (sz < Alignment) {
+	    // Tiny objects are smaller than any size class.
+	    assert (sz == TinyObjectSize);
+	    _tinyHeap.insert ((HL::SLList::Entry *) ptr);
+	    _localHeapBytes += TinyObjectSize;
+	  } else {
+	    unsigned int c = getSizeClass (sz);
+
+	    _localHeap(c).insert ((HL::SLList::Entry *) ptr);
+	    _localHeapBytes += getClassSize(c); // sz;
+	  }
       	  
       	} else {
 
@@ -138,7 +190,12 @@ namespace Hoard {
     }
 
     void clear (void) {
+      flushForeign();
       // Free every object to the 'parent' heap.
+      while (!_tinyHeap.isEmpty()) {
+	_parentHeap->free (_tinyHeap.get());
+	_localHeapBytes -= TinyObjectSize;
+      }
       int i = NumBins - 1;
       while ((_localHeapBytes > 0) && (i >= 0)) {
       	const size_t sz = getClassSize (i);
@@ -151,12 +208,94 @@ namespace Hoard {
       }
     }
 
+    /// @brief Return all queued objects to their owners (which
+    /// clear does too, along with everything else we hold).
+    void flushForeign (void) {
+      if (_foreignCount > 0) {
+	// Empty the queue first: if another thread forks while we wait
+	// for an owner's lock, the child must not free these again (see
+	// childAfterFork in unixtls.cpp).
+	const unsigned int n = _foreignCount;
+	_foreignCount = 0;
+	_parentHeap->freeBatch (_foreign, n);
+      }
+    }
+
     static inline SuperblockType * getSuperblock (void * ptr) {
       return SuperblockType::getSuperblock (ptr);
     }
 
+    /// Where we go for more memory.
+    ParentHeap& getParentHeap (void) const {
+      return *_parentHeap;
+    }
+
+    /// A tiny object from our own list, if we have one.
+    inline void * mallocTinyLocal (void) {
+      void * ptr = _tinyHeap.get();
+      if (ptr) {
+	assert (_localHeapBytes >= TinyObjectSize);
+	_localHeapBytes -= TinyObjectSize;
+      }
+      return ptr;
+    }
+
+    /// @brief Forget which heap our thread allocates from, before we
+    /// pass to another thread; the next malloc finds it again.
+    void forgetLocalHeap (void) {
+      _localOwner = NULL;
+    }
+
+    /// The number of bytes of free objects we hold.
+    size_t getLocalHeapBytes (void) const {
+      return _localHeapBytes;
+    }
+
+    /// @brief The most bytes of free objects we hold: a quarter as
+    /// much for each level of memory pressure (see MemoryPressure).
+    static inline size_t localHeapThreshold (void) {
+#if HOARD_MEMORY_PRESSURE
+      return LocalHeapThreshold >> (2 * hoardMemoryPressure);
+#else
+      return LocalHeapThreshold;
+#endif
+    }
+
   private:
 
+    enum { TinyObjectSize = SuperblockType::Header::TinyObjectSize };
+
+    /// @brief Does this thread's heap own the given superblock?
+    /// @note  A superblock that has since moved to the global heap
+    /// counts as foreign, which returns its objects there.
+    inline bool isLocal (const SuperblockType * s) const {
+      return (s->getOwner() == _localOwner);
+    }
+
+    /// Does an arena own the given superblock?
+    static inline bool isArena (const SuperblockType * s) {
+      int kind;
+      s->getOwner (kind);
+      return (kind == ArenaHeapOwner);
+    }
+
+    /// Queue an object for return to its owner, a batch at a time.
+    inline void freeForeign (void * ptr) {
+      _foreign[_foreignCount++] = ptr;
+      if (_foreignCount == ForeignFreeBatch) {
+	flushForeign();
+      }
+    }
+
+    /// @brief The largest object we hold locally.
+    /// @note  Until the first thread is created, no other heap could
+    /// use what we hold, so we hold objects up to a larger size and
+    /// keep frees of those objects off the parent heap. Whoever creates
+    /// the first thread must clear() us first (see unixtls.cpp).
+    static inline size_t largestObject (void) {
+      return anyThreadCreated ? LargestObject : LargestSequentialObject;
+    }
+
     // Disable assignment and copying.
 
     ThreadLocalAllocationBuffer (const ThreadLocalAllocationBuffer&);
@@ -171,6 +310,18 @@ namespace Hoard {
     /// The local heap itself.
     Array<NumBins, HL::SLList> _localHeap;
 
+    /// Tiny objects (see mallocTiny).
+    HL::SLList _tinyHeap;
+
+    /// The heap that owns the objects this thread allocates.
+    const void * _localOwner;
+
+    /// The number of objects in the foreign queue.
+    unsigned int _foreignCount;
+
+    /// Objects owned by other heaps, waiting to go back to them.
+    void * _foreign[ForeignFreeBatch > 0 ? ForeignFreeBatch : 1];
+
   };
 
 }
@@ -0,0 +1,248 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/**
+ * @file   addresswindow.h
+ * @brief  A superblock source confined to one 4GB window of address
+ *         space, so that a 32-bit offset from the window's base names
+ *         anything in it.
+ */
+
+#ifndef HOARD_ADDRESSWINDOW_H
+#define HOARD_ADDRESSWINDOW_H
+
+// Only 64-bit Unix builds need (and have room for) a window: in
+// 32-bit builds, every address already fits in 32 bits.
+#if !defined(_WIN32) && (defined(__LP64__) || defined(_LP64))
+#define HOARD_ADDRESS_WINDOW 1
+#endif
+
+#if HOARD_ADDRESS_WINDOW
+
+#include <sys/mman.h>
+
+#include "heaplayers.h"
+#include "exactlyone.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+namespace Hoard {
+
+  /**
+   * @class AddressWindowInstance
+   * @brief Hands out SuperblockSize-aligned memory from one 4GB
+   * reservation, made the first time it is needed: at Base if nothing
+   * is mapped there (so that programs may fix the base at build
+   * time), and wherever the kernel likes otherwise.
+   *
+   * Superblocks freed here give their pages back to the OS (as the
+   * big-object source does) but keep their addresses, which go to
+   * the next malloc; the window itself never shrinks.
+   */
+
+  template <size_t SuperblockSize,
+	    size_t Base,
+	    class LockType>
+  class AddressWindowInstance {
+  public:
+
+    enum { Alignment = SuperblockSize };
+
+    AddressWindowInstance()
+      : _base (NULL),
+	_failed (false),
+	_used (0),
+	_freeList (NULL)
+    {
+      HL::sassert<(Base % SuperblockSize == 0)> verifyAlignedBase;
+      verifyAlignedBase = verifyAlignedBase;
+    }
+
+    void clear() {
+      // NOP: the window is never given back.
+    }
+
+    inline void * malloc (size_t sz) {
+      HL::Guard<LockType> l (_lock);
+      sz = HL::align<SuperblockSize>(sz);
+      if ((sz == SuperblockSize) && (_freeList != NULL)) {
+	FreeSuperblock * f = _freeList;
+	_freeList = f->next;
+	return f;
+      }
+      if (!reserve() || (sz > WindowSize - _used)) {
+	return NULL;
+      }
+      char * ptr = _base + _used;
+      if (mmap (ptr, sz, Protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+	return NULL;
+      }
+      _used += sz;
+      return ptr;
+    }
+
+    inline void free (void * ptr) {
+      HL::Guard<LockType> l (_lock);
+      if (!contains (ptr)) {
+	return;
+      }
+      // Release the pages first: the link below lands on a fresh,
+      // zeroed page, so a free superblock costs one page of memory.
+      HL::MmapWrapper::release (ptr, SuperblockSize);
+      FreeSuperblock * f = (FreeSuperblock *) ptr;
+      f->next = _freeList;
+      _freeList = f;
+    }
+
+    inline size_t getSize (void * ptr) {
+      return contains (ptr) ? SuperblockSize : 0;
+    }
+
+    /// @return the window's base, or NULL if it could not be reserved.
+    void * base (void) {
+      HL::Guard<LockType> l (_lock);
+      return reserve() ? _base : NULL;
+    }
+
+    /// Hold off all changes (e.g., around fork()).
+    void lock (void) {
+      _lock.lock();
+    }
+
+    void unlock (void) {
+      _lock.unlock();
+    }
+
+  private:
+
+    static const size_t WindowSize = (size_t) 1 << 32;
+
+#if HL_EXECUTABLE_HEAP
+    enum { Protection = PROT_READ | PROT_WRITE | PROT_EXEC };
+#else
+    enum { Protection = PROT_READ | PROT_WRITE };
+#endif
+
+    struct FreeSuperblock {
+      FreeSuperblock * next;
+    };
+
+    bool contains (void * ptr) const {
+      return (_base != NULL) && ((char *) ptr >= _base) && ((char *) ptr < _base + _used);
+    }
+
+    /// Reserve the window, if we have not yet. Call with the lock held.
+    bool reserve (void) {
+      if (_base != NULL) {
+	return true;
+      }
+      if (_failed) {
+	return false;
+      }
+      // Kernels before 4.17 take MAP_FIXED_NOREPLACE's address as a
+      // mere hint, and may map the window somewhere else.
+      void * p = mmap ((void *) Base, WindowSize, PROT_NONE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+      if ((p != MAP_FAILED) && (p != (void *) Base)) {
+	munmap (p, WindowSize);
+	p = MAP_FAILED;
+      }
+      if (p == MAP_FAILED) {
+	// Something is in the way: take any window, aligned to a superblock.
+	char * q = (char *) mmap (NULL, WindowSize + SuperblockSize, PROT_NONE,
+				  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (q == (char *) MAP_FAILED) {
+	  _failed = true;
+	  return false;
+	}
+	p = (void *) HL::align<SuperblockSize>((size_t) q);
+      }
+      _base = (char *) p;
+      return true;
+    }
+
+    /// The start of the window, once reserved.
+    char * _base;
+
+    /// True if we could not reserve the window.
+    bool _failed;
+
+    /// The bytes from the base handed out so far.
+    size_t _used;
+
+    /// Superblocks freed here (their pages released), for reuse.
+    FreeSuperblock * _freeList;
+
+    LockType _lock;
+
+  };
+
+
+  /**
+   * @class AddressWindow
+   * @brief Route requests to the one address window instance.
+   */
+
+  template <size_t SuperblockSize,
+	    size_t Base,
+	    class LockType>
+  class AddressWindow : public ExactlyOne<AddressWindowInstance<SuperblockSize, Base, LockType> > {
+  public:
+
+    enum { Alignment = SuperblockSize };
+
+    inline void * malloc (size_t sz) {
+      return (*this)().malloc (sz);
+    }
+    inline void free (void * ptr) {
+      (*this)().free (ptr);
+    }
+    inline size_t getSize (void * ptr) {
+      return (*this)().getSize (ptr);
+    }
+    inline void clear() {
+      (*this)().clear();
+    }
+    inline void * base (void) {
+      return (*this)().base();
+    }
+    inline void lock (void) {
+      (*this)().lock();
+    }
+    inline void unlock (void) {
+      (*this)().unlock();
+    }
+
+  };
+
+}
+
+#endif
+
+#endif
@@ -37,6 +37,7 @@
 #include "heaplayers.h"
 #include "exactlyoneheap.h"
 #include "mmapalloc.h"
+#include "dynamichashtable.h"
 
 using namespace std;
 using namespace HL;
@@ -47,18 +48,22 @@ namespace Hoard {
    * @class AlignedMmapInstance
    * @brief Memory allocated from here is aligned with respect to Alignment.
    * @author Emery Berger <http://www.cs.umass.edu/~emery>
+   *
+   * Thread-safe without a lock of its own: mmap and munmap need
+   * none, and the map of sizes only locks to change (see
+   * DynamicHashTable), so size queries and frees run in parallel.
    */
 
   template <size_t Alignment,
 	    class LockType>
   class AlignedMmap;
 
-  template <size_t Alignment_>
+  template <size_t Alignment_,
+	    class LockType>
   class AlignedMmapInstance {
   public:
 
     AlignedMmapInstance()
-      : MyMap (16381) // entries in the hash map.
     {}
 
     enum { Alignment = Alignment_ };
@@ -75,7 +80,9 @@ namespace Hoard {
       // If the memory is already suitably aligned, just track size requests.
       if ((size_t) HL::MmapWrapper::Alignment % (size_t) Alignment == 0) {
 	void * ptr = HL::MmapWrapper::map (sz);
-	MyMap.set (ptr, sz);
+	if (ptr != NULL) {
+	  MyMap.insert ((size_t) ptr, sz);
+	}
 	assert ((size_t) ptr % Alignment == 0);
 	return ptr;
       }
@@ -87,9 +94,13 @@ namespace Hoard {
 
       ptr = HL::MmapWrapper::map (sz);
 
+      if (ptr == NULL) {
+	return NULL;
+      }
+
       if ((size_t) ptr == HL::align<Alignment>((size_t) ptr)) {
 	// We're done.
-	MyMap.set (ptr, sz);
+	MyMap.insert ((size_t) ptr, sz);
 	return ptr;
       }
 
@@ -110,14 +121,25 @@ namespace Hoard {
 	return;
       }
 
-      HL::MmapWrapper::unmap (ptr, requestedSize);
+      // Forget the mapping before undoing it, since once it is
+      // undone, mmap may hand the same address to another thread.
+      MyMap.erase ((size_t) ptr);
 
-      // Finally, undo the mapping.
-      MyMap.erase (ptr);
+      HL::MmapWrapper::unmap (ptr, requestedSize);
     }
   
     inline size_t getSize (void * ptr) {
-      return MyMap.get (ptr);
+      size_t sz;
+      return MyMap.get ((size_t) ptr, sz) ? sz : 0;
+    }
+
+    /// Hold off changes to the map (e.g., around fork()).
+    void lock (void) {
+      MyMap.lock();
+    }
+
+    void unlock (void) {
+      MyMap.unlock();
     }
 
 
@@ -152,25 +174,16 @@ namespace Hoard {
 
       // Now record the size associated with this pointer.
 
-      MyMap.set (newptr, sz);
+      MyMap.insert ((size_t) newptr, sz);
       return newptr;
     }
 
-    // Manage information in a map that uses a custom heap for
-    // allocation.
-
-    /// The key is an mmapped pointer.
-    typedef void * keyType;
-
-    /// The value is the requested size.
-    typedef size_t valType;
-
-    // The heap from which memory comes for the Map's purposes.
-    // Objects come from chunks via mmap, and we manage these with a free list.
-    class SourceHeap : public HL::FreelistHeap<BumpAlloc<65536, MmapAlloc> > { };
+    // Manage information in a map that gets its tables straight from
+    // mmap (and gives them back once no reader needs them; see
+    // DynamicHashTable).
 
-    /// The map type, with all the pieces in place.
-    typedef MyHashMap<keyType, valType, SourceHeap> mapType;
+    /// The key is an mmapped pointer; the value is the requested size.
+    typedef DynamicHashTable<size_t, 2, 16384, MmapAlloc, LockType> mapType;
 
     /// The map that maintains the size of each mmapped chunk.
     mapType MyMap;
@@ -187,7 +200,7 @@ namespace Hoard {
   template <size_t Alignment_,
 	    class LockType>
   class AlignedMmap :
-    public ExactlyOneHeap<LockedHeap<LockType, AlignedMmapInstance<Alignment_> > > {};
+    public ExactlyOneHeap<AlignedMmapInstance<Alignment_, LockType> > {};
 
 }
 
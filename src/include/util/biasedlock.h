@@ -0,0 +1,201 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_BIASEDLOCK_H
+#define HOARD_BIASEDLOCK_H
+
+#if !defined(__linux__)
+#error "Biased locking (HOARD_BIASED_LOCK) is only supported on Linux."
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "heaplayers.h"
+
+#if !defined(__NR_membarrier) && defined(__x86_64__)
+#define __NR_membarrier 324
+#endif
+
+namespace Hoard {
+
+  /**
+   * @class BiasedLock
+   * @brief A lock that one thread can take and release without any
+   * atomic instruction, for as long as no other thread wants it.
+   *
+   * Once a thread has taken the lock enough times in a row, the lock
+   * is biased toward it: from then on, that thread just announces
+   * itself (_busy) and checks that the bias still holds (_revoked).
+   * Any other thread takes the underlying lock and revokes the bias:
+   * it sets _revoked, runs membarrier(2) so that each side sees the
+   * other's write, and waits for the biased thread to leave. Each
+   * revocation doubles the run it takes to earn the bias back, so
+   * locks that are really shared soon stop paying for membarrier.
+   *
+   * The bias only ever moves from a thread to nobody (see unbias,
+   * which the biased thread calls when it is done with the lock), and
+   * from nobody to a thread, so no other thread can be caught between
+   * checking the bias and announcing itself.
+   */
+
+  template <class LockType>
+  class BiasedLock {
+  public:
+
+    BiasedLock (void)
+      : _biasedTo (0),
+	_revoked (1),
+	_busy (0),
+	_lastLocker (0),
+	_run (0),
+	_rebiasAfter (InitialRun)
+    {}
+
+    inline void lock (void) {
+      const unsigned long me = self();
+      if (_biasedTo == me) {
+	_busy = 1;
+	// membarrier (see revoke) makes this store and the load below
+	// ordered against the revoking thread.
+	__atomic_signal_fence (__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n (&_revoked, __ATOMIC_ACQUIRE)) {
+	  return;
+	}
+	__atomic_store_n (&_busy, 0, __ATOMIC_RELEASE);
+      }
+      lockSlow (me);
+    }
+
+    inline void unlock (void) {
+      // Only the biased thread ever sets _busy.
+      if (_busy && (_biasedTo == self())) {
+	__atomic_store_n (&_busy, 0, __ATOMIC_RELEASE);
+	return;
+      }
+      _lock.unlock();
+    }
+
+    /// @brief Drop the bias, if the calling thread holds it (as it
+    /// gives up the heap this lock guards; see HeapManager::releaseHeap).
+    void unbias (void) {
+      const unsigned long me = self();
+      if (_biasedTo != me) {
+	return;
+      }
+      _lock.lock();
+      _revoked = 1;
+      _biasedTo = 0;
+      _run = 0;
+      _lock.unlock();
+    }
+
+  private:
+
+    /// How many acquisitions in a row earn a thread the bias, at first.
+    enum { InitialRun = 64 };
+
+    /// The most it can ever take.
+    enum { MaxRun = 65536 };
+
+    static inline unsigned long self (void) {
+      return (unsigned long) pthread_self();
+    }
+
+    NO_INLINE void lockSlow (unsigned long me) {
+      _lock.lock();
+      if (me != _lastLocker) {
+	_lastLocker = me;
+	_run = 0;
+      }
+      _run++;
+      if ((_biasedTo != me) && !_revoked) {
+	revoke();
+      }
+      if (_revoked && (_run >= _rebiasAfter)
+	  && ((_biasedTo == me) || ((_biasedTo == 0) && canRevoke()))) {
+	// Nobody else has wanted this lock for a while: take the bias.
+	_biasedTo = me;
+	_run = 0;
+	__atomic_store_n (&_revoked, 0, __ATOMIC_RELEASE);
+      }
+    }
+
+    /// Take the bias away from its thread, and wait for it to leave.
+    void revoke (void) {
+      __atomic_store_n (&_revoked, 1, __ATOMIC_SEQ_CST);
+      syscall (__NR_membarrier, MembarrierPrivateExpedited, 0);
+      while (__atomic_load_n (&_busy, __ATOMIC_ACQUIRE)) {
+	sched_yield();
+      }
+      if (_rebiasAfter < MaxRun) {
+	_rebiasAfter *= 2;
+      }
+    }
+
+    /// @brief Can we revoke a bias at all? That takes a kernel with
+    /// private expedited membarrier (4.14 or later).
+    static bool canRevoke (void) {
+      static int registered = -1;
+      if (registered < 0) {
+	registered =
+	  (syscall (__NR_membarrier, MembarrierRegisterPrivateExpedited, 0) == 0);
+      }
+      return (registered == 1);
+    }
+
+    // From <linux/membarrier.h>, which older systems lack.
+    enum { MembarrierPrivateExpedited = (1 << 3),
+	   MembarrierRegisterPrivateExpedited = (1 << 4) };
+
+    /// The lock that everyone but the biased thread takes.
+    LockType _lock;
+
+    /// The thread the lock is biased toward, if any (changed only
+    /// under _lock, and only to or from 0).
+    volatile unsigned long _biasedTo;
+
+    /// True when the bias does not hold (written only under _lock).
+    volatile int _revoked;
+
+    /// True while the biased thread holds the lock without _lock.
+    volatile int _busy;
+
+    /// The thread that last took _lock, and how many times in a row.
+    unsigned long _lastLocker;
+    int _run;
+
+    /// The run that (re)earns the bias.
+    int _rebiasAfter;
+
+  };
+
+}
+
+#endif
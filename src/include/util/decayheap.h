@@ -0,0 +1,76 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_DECAYHEAP_H
+#define HOARD_DECAYHEAP_H
+
+#include "heaplayers.h"
+#include "registry.h"
+
+namespace Hoard {
+
+  /**
+   * @class DecayHeap
+   * @brief A locked heap whose instances can all be decayed at once.
+   *
+   * Each instance registers itself when constructed; decayAll() locks
+   * every registered heap in turn and calls its decay(pressure), with
+   * the level of memory pressure (see MemoryPressure), which lets a
+   * maintenance thread trim cached memory off the request path (see
+   * hoardMaintain).
+   */
+
+  template <class LockType,
+	    int MaxHeaps,
+	    class SuperHeap>
+  class DecayHeap : public SuperHeap {
+  public:
+
+    DecayHeap (void)
+    {
+      Heaps::add (this);
+    }
+
+    static void decayAll (int pressure) {
+      HL::Guard<LockType> g (Heaps::lock());
+      for (int i = 0; i < Heaps::size(); i++) {
+	DecayHeap * h = Heaps::get(i);
+	h->lock();
+	h->decay (pressure);
+	h->unlock();
+      }
+    }
+
+  private:
+
+    typedef Registry<DecayHeap, LockType, MaxHeaps> Heaps;
+
+  };
+
+}
+
+#endif
@@ -1,62 +1,134 @@
 #include "dynamichashtable.h"
 
+#include <pthread.h>
+#include <stdlib.h>
+
 #include <iostream>
-#include <sstream>
 
 using namespace std;
 
 //#include "heaplayers.h"
 using namespace HL;
 
-class Item {
-public:
+// Keys look like page-aligned pointers; each maps to a size.
+
+static const unsigned int NUM_ITERATIONS = 100000;
+
+static size_t keyOf (unsigned int i) {
+  return ((size_t) i + 1) << 12;
+}
+
+typedef DynamicHashTable<size_t, 2, 128> tableType;
 
-  Item()
-    : _hash (0)
-  {}
+static tableType dh;
 
-  Item (unsigned long value,
-	string s)
-    : _hash (value),
-      _str (s)
-  {}
+// Counts the bytes that a table holds, so we can check that churn
+// (inserting and erasing, with few elements at any one time) neither
+// leaks old tables nor keeps growing.
 
-  unsigned long hashCode() const {
-    return _hash;
+class CountingHeap {
+public:
+  static void * malloc (size_t sz) {
+    held += sz;
+    if (held > peak) {
+      peak = held;
+    }
+    return ::malloc (sz);
+  }
+  static void free (void * ptr, size_t sz) {
+    held -= sz;
+    ::free (ptr);
   }
+  static size_t held;
+  static size_t peak;
+};
+
+size_t CountingHeap::held = 0;
+size_t CountingHeap::peak = 0;
+
+typedef DynamicHashTable<size_t, 2, 128, CountingHeap> churnType;
+
+static churnType churn;
 
-  const string& getString() const {
-    return _str;
+static volatile bool churning = true;
+
+static void * churnReader (void *) {
+  unsigned int i = 0;
+  while (churning) {
+    size_t v;
+    churn.get (keyOf (i++ % 1000), v);
   }
+  return NULL;
+}
 
-private:
-  unsigned long _hash;
-  string _str;
-};
+// Look up keys [0, NUM_ITERATIONS/2), which stay put, while the main
+// thread inserts and erases others (growing the table as it goes).
+
+static void * reader (void *) {
+  size_t misses = 0;
+  for (unsigned int round = 0; round < 20; round++) {
+    for (unsigned int i = 0; i < NUM_ITERATIONS / 2; i++) {
+      size_t v;
+      if (!dh.get (keyOf (i), v) || (v != i)) {
+	misses++;
+      }
+    }
+  }
+  return (void *) misses;
+}
 
 int
 main()
 {
-  const unsigned int NUM_ITERATIONS = 100000;
-  DynamicHashTable<Item, 2, 128> dh;
+  for (unsigned int i = 0; i < NUM_ITERATIONS / 2; i++) {
+    dh.insert (keyOf (i), i);
+  }
 
-  for (unsigned int i = 0; i < NUM_ITERATIONS; i++) {
-    stringstream ss;
-    ss << "foo:" << i;
-    dh.insert (Item (i, ss.str()));
+  pthread_t readers[4];
+  for (int t = 0; t < 4; t++) {
+    pthread_create (&readers[t], NULL, reader, NULL);
   }
 
-  Item k;
+  for (unsigned int i = NUM_ITERATIONS / 2; i < NUM_ITERATIONS; i++) {
+    dh.insert (keyOf (i), i);
+  }
   for (unsigned int i = 0; i < 100000; i++) {
-    bool r0 = dh.erase (rand() % NUM_ITERATIONS);
+    dh.erase (keyOf (NUM_ITERATIONS / 2 + rand() % (NUM_ITERATIONS / 2)));
+  }
+
+  size_t misses = 0;
+  for (int t = 0; t < 4; t++) {
+    void * r;
+    pthread_join (readers[t], &r);
+    misses += (size_t) r;
   }
+  cout << "misses = " << misses << endl;
 
-  for (unsigned int i = 0; i < NUM_ITERATIONS-1; i++) {
-    bool r = dh.get (i, k);
-    cout << "r = " << r << endl;
-    //    assert (r);
+  size_t v;
+  for (unsigned int i = 0; i < NUM_ITERATIONS / 2; i++) {
+    if (!dh.get (keyOf (i), v) || (v != i)) {
+      cout << "lost key " << i << endl;
+    }
   }
 
+  // Churn: at most 32 keys live at a time, out of a million.
+  pthread_create (&readers[0], NULL, churnReader, NULL);
+  for (unsigned int i = 0; i < 1000000; i++) {
+    churn.insert (keyOf (i), i);
+    if (i >= 32) {
+      churn.erase (keyOf (i - 32));
+    }
+  }
+  churning = false;
+  pthread_join (readers[0], NULL);
+  // A table of 128 entries, plus one being grown into, plus a couple
+  // that readers may still be in.
+  const size_t bound = 4 * (128 * 2 * sizeof(size_t) + 64);
+  cout << "churn peak = " << CountingHeap::peak << " bytes (bound " << bound << ")" << endl;
+  if (CountingHeap::peak > bound) {
+    cout << "churn grew the table" << endl;
+    return 1;
+  }
 
   return 0;
 }
@@ -2,9 +2,19 @@
 
 /**
  * @file   dynamichashtable.h
- * @brief  A thread-safe dynamic hash table based on linear probing.
+ * @brief  A concurrent dynamic hash table based on linear probing.
  * @author Emery Berger <http://www.cs.umass.edu/~emery>
  * @note   Copyright (C) 2013 by Emery Berger, University of Massachusetts Amherst.
+ *
+ * Readers never lock: get() runs in parallel with other readers and
+ * with writers. Writers (insert and erase) serialize on a lock, and
+ * each one moves a few entries of an old table into a new one, so
+ * that growing never stops the world. A reader that might have raced
+ * with a move looks again.
+ *
+ * Readers announce themselves on striped counters, so that a writer
+ * can tell when nobody can still be looking at a retired table, and
+ * free it.
  **/
 
 #ifndef DYNAMICHASHTABLE_H
@@ -12,9 +22,11 @@
 
 #include <new>
 #include <stdint.h>
+#include <string.h>
 
 #include "heaplayers.h"
 #include "checkpoweroftwo.h"
+#include "mmapalloc.h"
 
 // LOAD_FACTOR_RECIPROCAL is the reciprocal of the maximum load factor
 // for the hash table.  In other words, 1/LOAD_FACTOR_RECIPROCAL is
@@ -22,14 +34,20 @@
 //
 // INIT_SIZE is the initial number of elements in the hash table.
 //
-// SourceHeap is the class that manages memory for the hash table's needs.
+// SourceHeap is the class that manages memory for the hash table's
+// needs; it must provide malloc(sz) and free(ptr, sz). A table that
+// has been grown out of is freed once every reader that might still
+// be looking at it has left (see reclaim).
 //
-// LockType is the kind of lock used to synchronize access to the hash table.
+// LockType is the kind of lock that writers hold.
+//
+// Keys are words other than 0 and 1 (pointers, say), and VALUE_TYPE
+// must fit in a word, so that both can be read and written atomically.
 
 template <class VALUE_TYPE,
 	  size_t LOAD_FACTOR_RECIPROCAL = 2,
 	  size_t INIT_SIZE = 4096,
-	  class SourceHeap = HL::MallocHeap,
+	  class SourceHeap = Hoard::MmapAlloc,
 	  class LockType = HL::PosixLockType>
 
 class DynamicHashTable {
@@ -38,249 +56,410 @@ class DynamicHashTable {
   // NOTE: This value *must* be a power of two, which we statically verify.
   enum { ExpansionFactor = 2 };
 
+  // How many entries each write moves from the old table to the new.
+  enum { MigrationBatch = 8 };
+
+  // Keys that mark an empty or a deleted cell.
+  enum { EMPTY = 0, DELETED = 1 };
+
+  // How many reader counters there are (see Readers), and how far
+  // apart they lie.
+  enum { ReaderStripes = 64, StripeSize = 64 };
+
 public:
 
   DynamicHashTable() :
-    _size (INIT_SIZE),
-    _entries (allocTable (INIT_SIZE)),
-    _numElements (0)
+    _table (allocTable (INIT_SIZE)),
+    _migrated (0),
+    _numElements (0),
+    _numUsed (0),
+    _epoch (0),
+    _retired (NULL),
+    _draining (NULL),
+    _drainingEpoch (0)
   {
     HL::sassert<(LOAD_FACTOR_RECIPROCAL > 1)> verify0;
     CheckPowerOfTwo<ExpansionFactor> verify1;
     CheckPowerOfTwo<INIT_SIZE> verify2;
+    HL::sassert<(sizeof(VALUE_TYPE) <= sizeof(size_t))> verify3;
+    CheckPowerOfTwo<ReaderStripes> verify4;
     verify0 = verify0;
     verify1 = verify1;
     verify2 = verify2;
-  }
-  
-  ~DynamicHashTable() {
-    Guard<LockType> l (_lock);
-    _sh.free (_entries);
+    verify3 = verify3;
+    verify4 = verify4;
+    if (_table == NULL) {
+      abort();
+    }
   }
 
-  /// @brief Get the object with the given key from the map.
-  bool get (unsigned long k, VALUE_TYPE& value) {
-    Guard<LockType> l (_lock);
-    return find (k, value);
+  /// @brief Get the value for the given key, without locking.
+  bool get (size_t key, VALUE_TYPE& value) const {
+    Readers& r = _readers[HL::CPUInfo::getThreadId() & (ReaderStripes - 1)];
+    const unsigned int e = enter (r);
+    bool found = false;
+    while (true) {
+      Table * t = load (_table);
+      // Entries move from the old table to the new one (copied, then
+      // deleted), so look in the old one first.
+      Table * old = load (t->older);
+      if ((old && old->find (key, value)) || t->find (key, value)) {
+	found = true;
+	break;
+      }
+      // If the table changed under us, an entry may have moved
+      // behind our back: look again.
+      if (load (_table) == t) {
+	break;
+      }
+    }
+    __atomic_sub_fetch (&r.count[e], 1, __ATOMIC_RELEASE);
+    return found;
   }
 
-  /// @brief Insert the given object into the map.
-  void insert (const VALUE_TYPE& s) 
+  /// @brief Map key to value, replacing any value it had.
+  void insert (size_t key, const VALUE_TYPE& value)
   {
-    Guard<LockType> l (_lock);
-
+    HL::Guard<LockType> l (_lock);
+    assert (key > DELETED);
+    migrate (MigrationBatch);
+    reclaim();
+    Table * t = _table;
+    if (t->older) {
+      eraseOne (t->older, key);
+    }
+    unsigned long index;
+    if (t->findIndex (key, index)) {
+      store (t->entries[index].value, (size_t) value);
+      return;
+    }
     // If adding this element would push us over our maximum load
     // factor, grow the hash table.
-    if ((_numElements+1) > _size / LOAD_FACTOR_RECIPROCAL) {
+    if ((_numUsed + 1) > t->size / LOAD_FACTOR_RECIPROCAL) {
       grow();
-    } 
-    insertOne (s);
+      t = _table;
+    }
+    if (insertOne (t, key, value)) {
+      _numUsed++;
+    }
     _numElements++;
   }
 
-
   /// @brief Erase the entry for a given key.
-  bool erase (unsigned long key)
+  bool erase (size_t key)
   {
-    Guard<LockType> l (_lock);
-    unsigned long index;
-    bool r = findIndex (key, index);
+    HL::Guard<LockType> l (_lock);
+    migrate (MigrationBatch);
+    reclaim();
+    Table * t = _table;
+    bool r = eraseOne (t, key);
+    if (r) {
+      _numUsed -= purge (t, key);
+    }
+    if (t->older && eraseOne (t->older, key)) {
+      r = true;
+    }
     if (r) {
-      _entries[index].erase();
       _numElements--;
-      if (_numElements < _size / (2 * ExpansionFactor * LOAD_FACTOR_RECIPROCAL)) {
-	  if (_numElements >= 2 * INIT_SIZE) {
-	    // Shrink.
-	    shrink();
-	  }
-      }
     }
     return r;
   }
 
+  /// Hold off writers (e.g., around fork()); readers carry on.
+  void lock (void) {
+    _lock.lock();
+  }
+
+  void unlock (void) {
+    _lock.unlock();
+  }
+
 private:
 
-  void insertOne (const VALUE_TYPE& s) 
+  class StoredObject {
+  public:
+    volatile size_t key;
+    volatile size_t value;
+  };
+
+  class Table {
+  public:
+    /// The number of cells. Always a power of two.
+    size_t size;
+
+    /// log2(size), for hashing.
+    unsigned int bits;
+
+    /// The table whose entries are moving here, if any.
+    Table * volatile older;
+
+    /// The next table waiting to be freed, once this one is retired.
+    Table * next;
+
+    /// The cells themselves (just past this header).
+    StoredObject * entries;
+
+    /// Spread keys (which, as pointers, share their low bits) over
+    /// the table, by Fibonacci hashing.
+    unsigned long hash (size_t key) const {
+      return (unsigned long) (((uint64_t) key * 11400714819323198485ULL) >> (64 - bits));
+    }
+
+    bool find (size_t key, VALUE_TYPE& value) const {
+      unsigned long i = hash (key);
+      while (true) {
+	const size_t k = load (entries[i].key);
+	if (k == EMPTY) {
+	  return false;
+	}
+	if (k == key) {
+	  value = (VALUE_TYPE) entries[i].value;
+	  return true;
+	}
+	i = (i+1) & (size - 1);
+      }
+    }
+
+    bool findIndex (size_t key, unsigned long& index) const {
+      unsigned long i = hash (key);
+      while (true) {
+	const size_t k = entries[i].key;
+	if (k == EMPTY) {
+	  return false;
+	}
+	if (k == key) {
+	  index = i;
+	  return true;
+	}
+	i = (i+1) & (size - 1);
+      }
+    }
+  };
+
+  /// @brief Put an entry in a free cell, found by linear probing.
+  /// @return true if the cell had never been used.
+  static bool insertOne (Table * t, size_t key, const VALUE_TYPE& value)
   {
-    // Put the object in a free spot via linear probing.
     // Note that this loop is guaranteed to terminate because the load
     // factor cannot be 1.0 (i.e., there is always an available slot).
-    unsigned long i = s.hashCode() & (_size - 1);
+    unsigned long i = t->hash (key);
     while (true) {
-      if (!_entries[i].isValid()) {
-	_entries[i].put (s);
-	return;
+      const size_t k = t->entries[i].key;
+      if ((k == EMPTY) || (k == DELETED)) {
+	// Publish the value before the key that makes it visible.
+	t->entries[i].value = (size_t) value;
+	store (t->entries[i].key, key);
+	return (k == EMPTY);
       }
-      i = (i+1) & (_size - 1);
+      i = (i+1) & (t->size - 1);
     }
   }
 
-  void grow() 
-  {
-    // Save old values.
-    size_t old_size             = _size;
-    StoredObject * old_entries  = _entries;
-    unsigned long old_elt_count = _numElements;
-
-    // Make room for a new table, growing the current one.
-    _size                      = _size * ExpansionFactor;
-    _entries                   = allocTable (_size);
-
-#if 0
-    {
-      char buf[255];
-      sprintf (buf, "GROWING, was %d/%d, now %d/%d\n", old_elt_count, old_size, _numElements, _size);
-      fprintf (stderr, buf);
+  static bool eraseOne (Table * t, size_t key) {
+    unsigned long index;
+    if (!t->findIndex (key, index)) {
+      return false;
     }
-#endif
+    store (t->entries[index].key, (size_t) DELETED);
+    return true;
+  }
 
-    if (_entries == NULL) {
-      // Failed to allocate space for a bigger table.
-      // Give up the ghost.
-      abort();
+  /// @brief Empty the deleted cells that end just before an empty
+  /// one, around the cell that key (just erased) hashed to.
+  /// No search for a key in the table gets past an empty cell, so
+  /// none can need these cells to keep going, and readers in the
+  /// middle of one are unaffected.
+  /// @return the number of cells emptied.
+  static size_t purge (Table * t, size_t key) {
+    const unsigned long mask = t->size - 1;
+    // Find the end of the run of used cells that key was in.
+    unsigned long i = t->hash (key);
+    while (t->entries[i].key != EMPTY) {
+      i = (i+1) & mask;
     }
-
-    // Rehash all the elements.
-    unsigned long ct = 0;
-    for (unsigned long i = 0; i < old_size; i++) {
-      VALUE_TYPE v;
-      bool isValid = old_entries[i].get (v);
-      if (isValid) {
-        ct++;
-	insertOne (v);
-      }
+    size_t n = 0;
+    i = (i-1) & mask;
+    while (t->entries[i].key == DELETED) {
+      store (t->entries[i].key, (size_t) EMPTY);
+      n++;
+      i = (i-1) & mask;
     }
-
-    assert (ct == _numElements);
-    _sh.free (old_entries);
+    return n;
   }
 
-  void shrink() 
+  /// @brief Start moving everything to a new table, big enough that
+  /// it is at most half as full as we allow. When deleted cells
+  /// rather than elements fill the table, the new one is the same
+  /// size, and the old one is freed once it is empty (see reclaim).
+  void grow()
   {
-    // Save old values.
-    size_t old_size             = _size;
-    StoredObject * old_entries  = _entries;
-    unsigned long old_elt_count = _numElements;
-
-    // Make room for a new table, growing the current one.
-    _size                      = _size / ExpansionFactor;
-    _entries                   = allocTable (_size);
-
-#if 0
-    {
-      char buf[255];
-      sprintf (buf, "SHRINKING, was %d/%d, now %d/%d\n", old_elt_count, old_size, _numElements, _size);
-      fprintf (stderr, buf);
-    }
-#endif
-
+    // Finish any move already under way first.
+    migrate (_table->older ? _table->older->size : 0);
 
-    if (_entries == NULL) {
+    size_t newSize = _table->size;
+    while ((_numElements + 1) * LOAD_FACTOR_RECIPROCAL * ExpansionFactor > newSize) {
+      newSize *= ExpansionFactor;
+    }
+    Table * t = allocTable (newSize);
+    if (t == NULL) {
       // Failed to allocate space for a bigger table.
       // Give up the ghost.
       abort();
     }
+    t->older = _table;
+    _migrated = 0;
+    _numUsed = _numElements;
+    store (_table, t);
+  }
 
-    // Rehash all the elements.
-    unsigned long ct = 0;
-    for (unsigned long i = 0; i < old_size; i++) {
-      VALUE_TYPE v;
-      bool isValid = old_entries[i].get (v);
-      if (isValid) {
-        ct++;
-	insertOne (v);
+  /// Move up to n entries from the old table, if there is one.
+  void migrate (size_t n) {
+    Table * t = _table;
+    Table * old = t->older;
+    if (old == NULL) {
+      return;
+    }
+    for (; (n > 0) && (_migrated < old->size); n--, _migrated++) {
+      StoredObject& e = old->entries[_migrated];
+      const size_t k = e.key;
+      if (k > DELETED) {
+	// Copy it, then delete the original (see get).
+	insertOne (t, k, (VALUE_TYPE) e.value);
+	store (e.key, (size_t) DELETED);
       }
     }
-
-    assert (ct == _numElements);
-    _sh.free (old_entries);
-  }
-
-  /// @brief Find the entry for a given key.
-  bool find (unsigned long key, VALUE_TYPE& value)
-  {
-    unsigned long index;
-    bool r = findIndex (key, index);
-    if (r) {
-      _entries[index].get (value);
+    if (_migrated == old->size) {
+      // The old table is retired; readers may still be in it, so
+      // queue it up for reclaim.
+      __atomic_store_n (&t->older, (Table *) NULL, __ATOMIC_SEQ_CST);
+      old->next = _retired;
+      _retired = old;
     }
-    return r;
   }
 
-  bool findIndex (unsigned long key, unsigned long& index) {
-    unsigned long i = key & (_size - 1);
-    while (true) {
-      VALUE_TYPE v;
-      bool isValid = _entries[i].get (v);
-      if (!isValid) {
-	return false;
+  /// @brief Free the retired tables that no reader can still be in.
+  ///
+  /// Readers count themselves in under the current epoch (see
+  /// enter). Once tables are retired, flipping the epoch means that
+  /// any reader who could have reached them counted in under the
+  /// old one; when the counts for the old epoch drain to zero, they
+  /// are all gone and we free the tables. We never wait: a writer
+  /// that finds readers still there leaves it to a later write.
+  void reclaim() {
+    if (_draining) {
+      for (int i = 0; i < ReaderStripes; i++) {
+	if (__atomic_load_n (&_readers[i].count[_drainingEpoch], __ATOMIC_SEQ_CST) != 0) {
+	  return;
+	}
       }
-      // Check the value.
-      if (v.hashCode() == key) {
-	index = i;
-	return true;
+      while (_draining) {
+	Table * t = _draining;
+	_draining = t->next;
+	_sh.free (t, sizeof(Table) + t->size * sizeof(StoredObject));
       }
-      i = (i+1) & (_size - 1);
+    }
+    if (_retired) {
+      _draining = _retired;
+      _retired = NULL;
+      _drainingEpoch = __atomic_fetch_add (&_epoch, 1, __ATOMIC_SEQ_CST) & 1;
     }
   }
 
-  class StoredObject {
-  private:
-    typedef enum { EMPTY, DELETED, OCCUPIED } Status;
-  public:
-    StoredObject()
-      : _status (EMPTY)
-    {}
-    bool isValid() const {
-      return (_status == OCCUPIED);
-    }
-    void erase() {
-      _status = DELETED;
-    }
-    bool get (VALUE_TYPE& v) const {
-      if (_status != OCCUPIED) {
-	return false;
-      }
-      v = _value;
-      return true;
+  /// Return a new, empty table of the appropriate size.
+  Table * allocTable (size_t nElts)
+  {
+    void * ptr =
+      _sh.malloc (sizeof(Table) + nElts * sizeof(StoredObject));
+    if (ptr == NULL) {
+      return NULL;
     }
-    void put (const VALUE_TYPE& v) {
-      _value = v;
-      _status = OCCUPIED;
+    Table * t = new (ptr) Table;
+    t->size = nElts;
+    t->bits = 0;
+    while (((size_t) 1 << t->bits) < nElts) {
+      t->bits++;
     }
-      
-  private:
-    /// Current status of the cell.
-    Status _status;
+    t->older = NULL;
+    t->next = NULL;
+    t->entries = reinterpret_cast<StoredObject *>(t + 1);
+    memset ((void *) t->entries, 0, nElts * sizeof(StoredObject));
+    return t;
+  }
+
+  /// Read a word that a writer may be changing, seeing everything
+  /// written before it. Sequentially consistent, so that a reader
+  /// who reaches a table was counted in before it was retired.
+  template <class T>
+  static T load (T const volatile & v) {
+    return __atomic_load_n (&v, __ATOMIC_SEQ_CST);
+  }
+
+  /// Write a word that readers may be reading, after everything
+  /// written before it.
+  template <class T>
+  static void store (T volatile & v, T x) {
+    __atomic_store_n (&v, x, __ATOMIC_RELEASE);
+  }
 
-    /// The value (if it is a valid object).
-    VALUE_TYPE _value;
+  /// The number of readers in get() that counted in under each
+  /// parity of the epoch. Striped across cache lines so that
+  /// readers on different threads mostly don't share one.
+  class Readers {
+  public:
+    volatile unsigned long count[2];
+  private:
+    char _pad[StripeSize - 2 * sizeof(unsigned long)];
   };
 
-  /// Return a new table of the appropriate size.
-  StoredObject * allocTable (unsigned long nElts)
-  {
-    void * ptr = 
-      _sh.malloc (nElts * sizeof(StoredObject));
-    return new (ptr) StoredObject[nElts];
+  /// @brief Count a reader in under the current epoch.
+  /// @return the parity it counted in under.
+  unsigned int enter (Readers& r) const {
+    while (true) {
+      const unsigned int e = __atomic_load_n (&_epoch, __ATOMIC_SEQ_CST) & 1;
+      __atomic_add_fetch (&r.count[e], 1, __ATOMIC_SEQ_CST);
+      // If the epoch flipped before we were counted, reclaim may
+      // have missed us: count in again under the new one.
+      if ((__atomic_load_n (&_epoch, __ATOMIC_SEQ_CST) & 1) == e) {
+	return e;
+      }
+      __atomic_sub_fetch (&r.count[e], 1, __ATOMIC_RELEASE);
+    }
   }
 
-  /// The lock for the heap itself.  Right now, it's just one big
-  /// lock, but ultimately it should be refined.
+  /// The lock that writers hold.
   LockType _lock;
 
   /// The heap from which we get memory to hold the hash table.
   SourceHeap _sh;
 
-  /// Current size of the hash table. Always a power of two.
-  size_t _size;
+  /// The current table.
+  Table * volatile _table;
 
-  /// The array of entries.
-  StoredObject * _entries;
+  /// How far we have moved entries out of the old table.
+  size_t _migrated;
 
   /// The total number of elements actually in the table.
   size_t _numElements;
 
+  /// The number of cells in the current table that are, or were, in
+  /// use (deleted cells still lengthen searches).
+  size_t _numUsed;
+
+  /// Readers in get(), by stripe and epoch parity.
+  mutable Readers _readers[ReaderStripes];
+
+  /// Bumped each time retired tables start draining.
+  volatile unsigned int _epoch;
+
+  /// Tables that have been retired since the epoch last changed.
+  Table * _retired;
+
+  /// Tables waiting for readers of the previous epoch to leave.
+  Table * _draining;
+
+  /// The epoch parity that those readers counted in under.
+  unsigned int _drainingEpoch;
+
 };
 
 #endif
@@ -50,6 +50,12 @@ namespace Hoard {
     inline void clear() {
       (*this)().clear();
     }
+    inline void lock() {
+      (*this)().lock();
+    }
+    inline void unlock() {
+      (*this)().unlock();
+    }
   };
 
 }
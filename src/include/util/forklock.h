@@ -0,0 +1,78 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_FORKLOCK_H
+#define HOARD_FORKLOCK_H
+
+#include "heaplayers.h"
+#include "registry.h"
+
+namespace Hoard {
+
+  /**
+   * @class ForkLock
+   * @brief A lock whose instances can all be held at once (around fork()).
+   *
+   * Each instance registers itself when constructed; lockAll() and
+   * unlockAll() take and release every registered lock. They go in
+   * registration order, which need not match any nesting order, so
+   * only use this for locks that are never held two at a time.
+   */
+
+  template <class LockType,
+	    int MaxLocks>
+  class ForkLock : public LockType {
+  public:
+
+    ForkLock (void)
+    {
+      Locks::add (this);
+    }
+
+    static void lockAll (void) {
+      Locks::lock().lock();
+      for (int i = 0; i < Locks::size(); i++) {
+	Locks::get(i)->lock();
+      }
+    }
+
+    static void unlockAll (void) {
+      for (int i = Locks::size() - 1; i >= 0; i--) {
+	Locks::get(i)->unlock();
+      }
+      Locks::lock().unlock();
+    }
+
+  private:
+
+    typedef Registry<ForkLock, LockType, MaxLocks> Locks;
+
+  };
+
+}
+
+#endif
@@ -42,6 +42,11 @@ namespace Hoard {
       HL::Guard<Heap> l (*this);
       return Heap::malloc (sz);
     }
+
+    MALLOC_FUNCTION INLINE void * mallocDense (size_t sz) {
+      HL::Guard<Heap> l (*this);
+      return Heap::mallocDense (sz);
+    }
   };
 
 }
@@ -0,0 +1,226 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_MEMORYPRESSURE_H
+#define HOARD_MEMORYPRESSURE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Hoard {
+
+  /**
+   * @class MemoryPressure
+   * @brief How close we are to running out of memory, judged from a
+   * cgroup (v2): how much of its limit (memory.max or memory.high,
+   * whichever is lower) memory.current has used, and how much time
+   * its tasks have recently spent stalled on memory (memory.pressure,
+   * or /proc/pressure/memory for our own cgroup).
+   *
+   * Any directory holding files of the same names will do, which lets
+   * made-up limits drive the allocator without a real cgroup.
+   */
+
+  class MemoryPressure {
+  public:
+
+    enum { None = 0, High = 1, Critical = 2 };
+
+    /// Past these percentages of the limit, pressure is High, then Critical.
+    enum { HighPercent = 80, CriticalPercent = 90 };
+
+    /// Past these percentages of time stalled (avg10), likewise.
+    enum { HighStallPercent = 10, CriticalStallPercent = 40 };
+
+    MemoryPressure (void)
+      : _watching (false),
+	_systemStalls (false)
+    {
+      _dir[0] = '\0';
+    }
+
+    /// @brief Watch the cgroup in dir, or our own if dir is NULL.
+    /// @return false if there is nothing there to watch.
+    bool watch (const char * dir) {
+      _watching = false;
+      _systemStalls = (dir == NULL);
+      if (dir == NULL) {
+	if (!findOwnCgroup()) {
+	  return false;
+	}
+      } else if (strlen (dir) < sizeof(_dir)) {
+	strcpy (_dir, dir);
+      } else {
+	return false;
+      }
+      unsigned long long current;
+      double stalled;
+      _watching = readNumber ("memory.current", current) || readStalls (stalled);
+      return _watching;
+    }
+
+    /// The level of pressure now: None, High or Critical.
+    int level (void) {
+      if (!_watching) {
+	return None;
+      }
+      int l = None;
+      unsigned long long limit = 0, v, current;
+      if (readNumber ("memory.max", v)) {
+	limit = v;
+      }
+      if (readNumber ("memory.high", v) && ((limit == 0) || (v < limit))) {
+	limit = v;
+      }
+      if ((limit > 0) && readNumber ("memory.current", current)) {
+	if (current >= limit / 100 * CriticalPercent) {
+	  l = Critical;
+	} else if (current >= limit / 100 * HighPercent) {
+	  l = High;
+	}
+      }
+      double stalled;
+      if (readStalls (stalled)) {
+	if (stalled >= CriticalStallPercent) {
+	  l = Critical;
+	} else if ((stalled >= HighStallPercent) && (l < High)) {
+	  l = High;
+	}
+      }
+      return l;
+    }
+
+  private:
+
+    enum { MaxPath = 4096 };
+
+    /// @brief Read our cgroup's path, from the line "0::/path" of
+    /// /proc/self/cgroup, into _dir.
+    bool findOwnCgroup (void) {
+      char buf[MaxPath];
+      if (!readFile ("/proc/self/cgroup", buf, sizeof(buf))) {
+	return false;
+      }
+      const char * line = buf;
+      while (strncmp (line, "0::", 3) != 0) {
+	line = strchr (line, '\n');
+	if (line == NULL) {
+	  return false;
+	}
+	line++;
+      }
+      static const char root[] = "/sys/fs/cgroup";
+      const char * path = line + 3;
+      const size_t len = strcspn (path, "\n");
+      if (sizeof(root) + len > sizeof(_dir)) {
+	return false;
+      }
+      strcpy (_dir, root);
+      strncat (_dir, path, len);
+      return true;
+    }
+
+    /// @brief Read a number of bytes from one of the cgroup's files.
+    /// @return false if it cannot be read or is "max" (no limit).
+    bool readNumber (const char * name, unsigned long long& v) {
+      char buf[64];
+      if (!readCgroupFile (name, buf, sizeof(buf))) {
+	return false;
+      }
+      char * end;
+      v = strtoull (buf, &end, 10);
+      return (end != buf);
+    }
+
+    /// Read the share of time some tasks were stalled on memory, as a percentage.
+    bool readStalls (double& stalled) {
+      char buf[256];
+      if (!readCgroupFile ("memory.pressure", buf, sizeof(buf))
+	  && !(_systemStalls && readFile ("/proc/pressure/memory", buf, sizeof(buf)))) {
+	return false;
+      }
+      // some avg10=1.23 avg60=0.50 avg300=0.10 total=12345
+      const char * p = strstr (buf, "some avg10=");
+      if (p == NULL) {
+	return false;
+      }
+      stalled = strtod (p + strlen ("some avg10="), NULL);
+      return true;
+    }
+
+    bool readCgroupFile (const char * name, char * buf, size_t sz) {
+      char path[MaxPath];
+      if (strlen (_dir) + 1 + strlen (name) >= sizeof(path)) {
+	return false;
+      }
+      strcpy (path, _dir);
+      strcat (path, "/");
+      strcat (path, name);
+      return readFile (path, buf, sz);
+    }
+
+    /// Read up to sz - 1 bytes of a file, and terminate them.
+    static bool readFile (const char * path, char * buf, size_t sz) {
+#if defined(__linux__)
+      const int fd = open (path, O_RDONLY);
+      if (fd < 0) {
+	return false;
+      }
+      const ssize_t n = read (fd, buf, sz - 1);
+      close (fd);
+      if (n <= 0) {
+	return false;
+      }
+      buf[n] = '\0';
+      return true;
+#else
+      // Only Linux has cgroups.
+      (void) path;
+      (void) buf;
+      (void) sz;
+      return false;
+#endif
+    }
+
+    /// The cgroup's directory.
+    char _dir[MaxPath];
+
+    bool _watching;
+
+    /// Fall back to system-wide stalls (only for our own cgroup).
+    bool _systemStalls;
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,680 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+
+  Copyright (c) 1998-2012 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/**
+ * @file mesharena.h
+ * @brief A superblock source backed by a memory file, so that two
+ *        virtual superblocks can be made to share one physical superblock.
+ * @author Emery Berger <http://www.cs.umass.edu/~emery>
+ */
+
+#ifndef HOARD_MESHARENA_H
+#define HOARD_MESHARENA_H
+
+#if !defined(__linux__)
+#error "Meshing (HOARD_MESH) is only supported on Linux."
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "heaplayers.h"
+#include "exactlyone.h"
+
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE 0x01
+#endif
+#ifndef FALLOC_FL_PUNCH_HOLE
+#define FALLOC_FL_PUNCH_HOLE 0x02
+#endif
+
+namespace Hoard {
+
+  /**
+   * @class MeshArenaInstance
+   * @brief Hands out SuperblockSize-aligned memory from one big
+   * virtual reservation, every slot of which is a shared mapping of
+   * the same offset in a memfd.
+   *
+   * Meshing a superblock ("drop") into another ("keep") remaps drop's
+   * slot onto keep's file offset and punches a hole where drop's
+   * pages used to be, so both virtual ranges now see one physical
+   * superblock. While the caller copies drop's objects across (through
+   * a separate view of the file), drop is write-protected; a SIGSEGV
+   * handler makes any other thread that writes to it wait and retry
+   * once the remap is done. That handler goes in before the first mesh
+   * (chaining to whatever was there); if the application later puts
+   * its own in its place, meshing stops.
+   *
+   * Because the mapping is shared, a forked child would otherwise
+   * share heap memory with its parent. Before fork, every slot in use
+   * is write-protected, as drop is while meshing. The child copies the
+   * file into one of its own, maps its slots from there, and closes
+   * its end of a pipe; the parent waits for that before it lets its
+   * threads write again. The parent's superblocks never stop being
+   * shared, so they go on meshing. A child that cannot get a file or
+   * a pipe of its own aborts rather than share the heap.
+   *
+   * If no memfd is available, the arena falls back to private
+   * anonymous memory and simply refuses to mesh.
+   */
+
+  template <size_t SuperblockSize,
+	    class LockType>
+  class MeshArenaInstance {
+  public:
+
+    enum { Alignment = SuperblockSize };
+
+    MeshArenaInstance()
+      : _fd (-1),
+	_base (NULL),
+	_view (NULL),
+	_nextSlot (0),
+	_freeSlots (NULL),
+	_numFree (0),
+	_target (NULL),
+	_aliases (NULL),
+	_nextAlias (NULL),
+	_forkRead (-1),
+	_forkWrite (-1),
+	_forkParent (0),
+	_borrowedHandler (false),
+	_barrierStart (NULL),
+	_barrierEnd (NULL),
+	_barrierOwner (0),
+	_handlerInstalled (false)
+    {
+      // Reserve the whole arena up front, aligned to a superblock,
+      // plus one more superblock to view drop through while meshing.
+      char * p = (char *) mmap (NULL, ArenaSize + 2 * SuperblockSize, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (p == (char *) MAP_FAILED) {
+	abort();
+      }
+      _base = (char *) HL::align<SuperblockSize>((size_t) p);
+      _view = _base + ArenaSize;
+      _target = (unsigned int *) HL::MmapWrapper::map (NumSlots * sizeof(unsigned int));
+      _aliases = (unsigned int *) HL::MmapWrapper::map (NumSlots * sizeof(unsigned int));
+      _nextAlias = (unsigned int *) HL::MmapWrapper::map (NumSlots * sizeof(unsigned int));
+      _freeSlots = (unsigned int *) HL::MmapWrapper::map (NumSlots * sizeof(unsigned int));
+      _fd = createFile();
+    }
+
+    void clear() {
+      // NOP: superblocks are never returned to the arena in bulk.
+    }
+
+    inline void * malloc (size_t sz) {
+      HL::Guard<LockType> l (_lock);
+      sz = HL::align<SuperblockSize>(sz);
+      const size_t n = sz / SuperblockSize;
+      size_t slot;
+      if ((n == 1) && (_numFree > 0)) {
+	// Reuse a slot that went back empty (its file pages are gone).
+	slot = _freeSlots[--_numFree];
+      } else if (_nextSlot + n <= NumSlots) {
+	slot = _nextSlot;
+      } else {
+	return NULL;
+      }
+      char * ptr = slotAddress (slot);
+      void * r;
+      if (_fd >= 0) {
+	r = mmap (ptr, sz, Protection, MAP_SHARED | MAP_FIXED, _fd, (off_t) (slot * SuperblockSize));
+      } else {
+	r = mmap (ptr, sz, Protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+      }
+      if (r == MAP_FAILED) {
+	if (slot < _nextSlot) {
+	  _freeSlots[_numFree++] = (unsigned int) slot;
+	}
+	return NULL;
+      }
+      for (size_t i = 0; i < n; i++) {
+	_target[slot + i] = (unsigned int) (slot + i + 1);
+      }
+      if (slot == _nextSlot) {
+	_nextSlot += n;
+      }
+      return ptr;
+    }
+
+    inline void free (void * ptr) {
+      // Release the physical memory, but keep the address range reserved.
+      HL::Guard<LockType> l (_lock);
+      const size_t slot = slotIndex (ptr);
+      if (!contains (ptr) || (_target[slot] != slot + 1)) {
+	// Not in use, or meshed onto another slot: those go with the
+	// superblock they were meshed into, which is the only one Hoard
+	// still knows about.
+	return;
+      }
+      // The superblock is empty, so no object is live at any address
+      // that maps it: unmap them all, then drop the pages.
+      for (size_t s = slot + 1; s != 0; ) {
+	const size_t next = _nextAlias[s - 1];
+	unmapSlot (s - 1);
+	// A later malloc may have the slot (and its empty file offset).
+	_freeSlots[_numFree++] = (unsigned int) (s - 1);
+	s = next;
+      }
+      _aliases[slot] = 0;
+      if (_fd >= 0) {
+	punchHole (slot);
+      }
+    }
+
+    inline size_t getSize (void * ptr) {
+      return (contains (ptr) && _target[slotIndex (ptr)]) ? SuperblockSize : 0;
+    }
+
+    /// @brief True iff meshing is possible at all.
+    bool canMesh (void) {
+      if (_fd < 0) {
+	return false;
+      }
+      HL::Guard<LockType> l (_lock);
+      return faultHandlerInPlace();
+    }
+
+    /// @brief True iff some other slot has been meshed onto this one.
+    bool isAliased (void * ptr) const {
+      return contains (ptr) && (_aliases[slotIndex (ptr)] > 0);
+    }
+
+    /// @brief True iff the superblock at ptr is a mapping of our file,
+    /// and so can take part in a mesh.
+    bool isShared (void * ptr) const {
+      return contains (ptr) && _target[slotIndex (ptr)];
+    }
+
+    /// @brief Write-protect drop while its objects are copied away,
+    /// and return a view of it to copy them from. Only other threads
+    /// wait on drop, so the caller must not touch it until endMesh.
+    /// Returns NULL (and meshes nothing) if our fault handler is gone.
+    const void * beginMesh (void * drop) {
+      _lock.lock();
+      assert (_fd >= 0);
+      if (!faultHandlerInPlace()) {
+	_lock.unlock();
+	return NULL;
+      }
+      assert (isShared (drop));
+      assert (_target[slotIndex (drop)] == slotIndex (drop) + 1);
+      void * r = mmap (_view, SuperblockSize, PROT_READ, MAP_SHARED | MAP_FIXED,
+		       _fd, (off_t) (slotIndex (drop) * SuperblockSize));
+      if (r == MAP_FAILED) {
+	abort();
+      }
+      _barrierOwner = (pid_t) syscall (SYS_gettid);
+      _barrierStart = (char *) drop;
+      _barrierEnd = (char *) drop + SuperblockSize;
+      __sync_synchronize();
+      mprotect (drop, SuperblockSize, PROT_READ);
+      return _view;
+    }
+
+    /// @brief Point drop at keep's physical superblock and free drop's own.
+    void endMesh (void * keep, void * drop) {
+      const size_t k = slotIndex (keep);
+      const size_t d = slotIndex (drop);
+      const size_t phys = _target[k] - 1;
+      void * r = mmap (drop, SuperblockSize, Protection, MAP_SHARED | MAP_FIXED,
+		       _fd, (off_t) (phys * SuperblockSize));
+      if (r == MAP_FAILED) {
+	// We cannot leave drop read-only (or unmapped): give up.
+	abort();
+      }
+      punchHole (d);
+      _target[d] = (unsigned int) (phys + 1);
+      _aliases[phys]++;
+      _nextAlias[d] = _nextAlias[phys];
+      _nextAlias[phys] = (unsigned int) (d + 1);
+      mmap (_view, SuperblockSize, PROT_NONE,
+	    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+      clearBarrier();
+      _lock.unlock();
+    }
+
+    /// @brief Before fork: stop meshing, and write-protect every slot
+    /// in use until the child has its own copy (see parentAfterFork).
+    void prepareFork (void) {
+      _lock.lock();
+      if (_fd < 0) {
+	return;
+      }
+      _forkParent = (pid_t) syscall (SYS_getpid);
+      int fds[2];
+      if (pipe2 (fds, O_CLOEXEC) != 0) {
+	// We could not tell when the child is done (it aborts).
+	return;
+      }
+      _forkRead = fds[0];
+      _forkWrite = fds[1];
+      // Writers wait in the fault handler, as for a mesh. If the
+      // application has replaced it, put it back for the fork only.
+      bool ours = faultHandlerInPlace();
+      if (!ours) {
+	_savedAction = previousAction();
+	ours = _borrowedHandler = installFaultHandler (this);
+      }
+      if (ours) {
+	_barrierOwner = (pid_t) syscall (SYS_gettid);
+	_barrierStart = _base;
+	_barrierEnd = _base + ArenaSize;
+	__sync_synchronize();
+	protectSlots (PROT_READ);
+      }
+    }
+
+    /// @brief After fork, in the parent: wait until the child has its
+    /// own copy of our superblocks, then resume.
+    void parentAfterFork (void) {
+      if (_forkWrite >= 0) {
+	// The read sees end-of-file once the child has closed its write
+	// end too (or died, or if there is no child).
+	close (_forkWrite);
+	char c;
+	while ((read (_forkRead, &c, 1) < 0) && (errno == EINTR)) {
+	}
+	close (_forkRead);
+	_forkRead = _forkWrite = -1;
+	if (_barrierOwner) {
+	  protectSlots (Protection);
+	}
+	endFork();
+      }
+      _forkParent = 0;
+      _lock.unlock();
+    }
+
+    /// @brief After fork, in the child: move to a file of our own,
+    /// unless a write has made us do so already (see faultHandler).
+    void childAfterFork (void) {
+      if (_forkParent) {
+	moveToOwnFile();
+      }
+      _lock.unlock();
+    }
+
+  private:
+
+    /// How much address space the arena reserves.
+    enum { ArenaSlots = (sizeof(void *) == 8) ? (1 << 20) : (1 << 13) };
+
+    static const size_t ArenaSize = (size_t) ArenaSlots * SuperblockSize;
+    static const size_t NumSlots = ArenaSlots;
+
+#if HL_EXECUTABLE_HEAP
+    enum { Protection = PROT_READ | PROT_WRITE | PROT_EXEC };
+#else
+    enum { Protection = PROT_READ | PROT_WRITE };
+#endif
+
+    bool contains (void * ptr) const {
+      return ((char *) ptr >= _base) && ((char *) ptr < _base + ArenaSize);
+    }
+
+    size_t slotIndex (void * ptr) const {
+      return ((size_t) ptr - (size_t) _base) / SuperblockSize;
+    }
+
+    char * slotAddress (size_t slot) const {
+      return _base + slot * SuperblockSize;
+    }
+
+    bool isBarrier (void * addr) const {
+      return ((char *) addr >= _barrierStart) && ((char *) addr < _barrierEnd);
+    }
+
+    void unmapSlot (size_t slot) {
+      mmap (slotAddress (slot), SuperblockSize, PROT_NONE,
+	    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+      _target[slot] = 0;
+      _nextAlias[slot] = 0;
+    }
+
+    void punchHole (size_t slot) {
+      fallocate (_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		 (off_t) (slot * SuperblockSize), (off_t) SuperblockSize);
+    }
+
+    void clearBarrier (void) {
+      __sync_synchronize();
+      _barrierStart = NULL;
+      _barrierEnd = NULL;
+      _barrierOwner = 0;
+    }
+
+    /// @brief Lift the fork's barrier, and give back the application's
+    /// fault handler if we borrowed its place.
+    void endFork (void) {
+      clearBarrier();
+      if (_borrowedHandler) {
+	sigaction (SIGSEGV, &previousAction(), NULL);
+	previousAction() = _savedAction;
+	_borrowedHandler = false;
+      }
+    }
+
+    /// @brief In a forked child: copy every superblock into a file of
+    /// our own and map it from there, since the parent keeps using its
+    /// file. Uses only system calls, as it may run in faultHandler.
+    void moveToOwnFile (void) {
+      const int fd = createFile();
+      if ((_forkWrite < 0) || (fd < 0) || !copyInto (fd)) {
+	// Mapping our superblocks from the parent's file would have us
+	// share them with it.
+	abort();
+      }
+      remapOnto (fd);
+      close (_fd);
+      _fd = fd;
+      close (_forkRead);
+      close (_forkWrite);
+      _forkRead = _forkWrite = -1;
+      _forkParent = 0;
+      endFork();
+    }
+
+    /// @brief Set the protection of every slot in use, a run at a time.
+    void protectSlots (int prot) {
+      size_t i = 0;
+      while (i < _nextSlot) {
+	size_t n = 0;
+	while ((i + n < _nextSlot) && _target[i + n]) {
+	  n++;
+	}
+	if (n > 0) {
+	  mprotect (slotAddress (i), n * SuperblockSize, prot);
+	}
+	i += n + 1;
+      }
+    }
+
+    /// @brief In a forked child: write every physical superblock in use
+    /// to the same offset of fd. Only the parts of the file that hold
+    /// data are copied, so that holes stay holes.
+    bool copyInto (int fd) {
+      for (size_t i = 0; i < _nextSlot; i++) {
+	if (_target[i] != i + 1) {
+	  // Unused, or an alias of the physical superblock we copy.
+	  continue;
+	}
+	const off_t start = (off_t) (i * SuperblockSize);
+	const off_t end = start + (off_t) SuperblockSize;
+	off_t from = start;
+	while (from < end) {
+	  off_t data = lseek (_fd, from, SEEK_DATA);
+	  if ((data < 0) && (errno == ENXIO)) {
+	    break;
+	  }
+	  off_t hole = (data < 0) ? end : lseek (_fd, data, SEEK_HOLE);
+	  if (data < 0) {
+	    // Cannot tell where the holes are: copy it all.
+	    data = from;
+	  }
+	  if ((hole < 0) || (hole > end)) {
+	    hole = end;
+	  }
+	  if (data >= end) {
+	    break;
+	  }
+	  const char * src = slotAddress (i) + (data - start);
+	  while (data < hole) {
+	    const ssize_t r = pwrite (fd, src, (size_t) (hole - data), data);
+	    if (r <= 0) {
+	      return false;
+	    }
+	    src += r;
+	    data += r;
+	  }
+	  from = hole;
+	}
+      }
+      return true;
+    }
+
+    /// @brief In a forked child, once copyInto succeeded: map every
+    /// slot in use shared from fd, at the offset it maps now.
+    void remapOnto (int fd) {
+      for (size_t i = 0; i < _nextSlot; i++) {
+	if (!_target[i]) {
+	  continue;
+	}
+	void * r = mmap (slotAddress (i), SuperblockSize, Protection,
+			 MAP_SHARED | MAP_FIXED, fd,
+			 (off_t) ((_target[i] - 1) * SuperblockSize));
+	if (r == MAP_FAILED) {
+	  abort();
+	}
+      }
+    }
+
+    static int createFile (void) {
+#if defined(SYS_memfd_create)
+      int fd = (int) syscall (SYS_memfd_create, "hoard-arena", 1U /* MFD_CLOEXEC */);
+      if (fd < 0) {
+	return -1;
+      }
+      if (ftruncate (fd, (off_t) ArenaSize) != 0) {
+	close (fd);
+	return -1;
+      }
+      return fd;
+#else
+      return -1;
+#endif
+    }
+
+    // The fault handler is process-wide, so it needs to find the arena.
+
+    static MeshArenaInstance *& theArena (void) {
+      static MeshArenaInstance * a = NULL;
+      return a;
+    }
+
+    static struct sigaction& previousAction (void) {
+      static struct sigaction act;
+      return act;
+    }
+
+    /// @brief True iff our fault handler is in place, installing it
+    /// the first time. Call with _lock held.
+    bool faultHandlerInPlace (void) {
+      struct sigaction cur;
+      if (sigaction (SIGSEGV, NULL, &cur) != 0) {
+	return false;
+      }
+      if ((cur.sa_flags & SA_SIGINFO) && (cur.sa_sigaction == faultHandler)) {
+	return true;
+      }
+      if (_handlerInstalled) {
+	// The application has replaced it since: a write to a barrier
+	// would no longer wait, so we must not put one up.
+	return false;
+      }
+      _handlerInstalled = installFaultHandler (this);
+      return _handlerInstalled;
+    }
+
+    static bool installFaultHandler (MeshArenaInstance * a) {
+      theArena() = a;
+      struct sigaction act;
+      memset (&act, 0, sizeof(act));
+      act.sa_sigaction = faultHandler;
+      act.sa_flags = SA_SIGINFO | SA_RESTART;
+      sigemptyset (&act.sa_mask);
+      return (sigaction (SIGSEGV, &act, &previousAction()) == 0);
+    }
+
+    static void faultHandler (int sig, siginfo_t * info, void * context) {
+      MeshArenaInstance * a = theArena();
+      if (a && a->isBarrier (info->si_addr) && a->_forkParent
+	  && (a->_forkParent != (pid_t) syscall (SYS_getpid))) {
+	// A forked child (which has only the one thread) writes before
+	// childAfterFork has run, as the C library may: copy now.
+	a->moveToOwnFile();
+	return;
+      }
+      if (a && a->isBarrier (info->si_addr)
+	  && (a->_barrierOwner != (pid_t) syscall (SYS_gettid))) {
+	// A write to a superblock that is being meshed. Wait until it
+	// is done, then retry the write. (The thread doing the meshing
+	// never writes there, so a fault of its own would never end:
+	// it is a real fault.)
+	while (a->isBarrier (info->si_addr)) {
+	  sched_yield();
+	}
+	return;
+      }
+      // Not ours: hand it to whoever was there before us.
+      struct sigaction& prev = previousAction();
+      if (prev.sa_flags & SA_SIGINFO) {
+	prev.sa_sigaction (sig, info, context);
+      } else if ((prev.sa_handler == SIG_DFL) || (prev.sa_handler == SIG_IGN)) {
+	// Restore the default and let the fault happen again.
+	sigaction (SIGSEGV, &prev, NULL);
+      } else {
+	prev.sa_handler (sig);
+      }
+    }
+
+    /// The memory file behind the arena (-1 if none).
+    int _fd;
+
+    /// The start of the reserved address range.
+    char * _base;
+
+    /// Where drop is visible to the meshing thread (see beginMesh).
+    char * _view;
+
+    /// The first slot never handed out.
+    size_t _nextSlot;
+
+    /// Slots below _nextSlot that are unmapped again, to hand out first.
+    unsigned int * _freeSlots;
+    size_t _numFree;
+
+    /// For each slot, one plus the physical slot it maps (0 = unmapped).
+    unsigned int * _target;
+
+    /// For each physical slot, how many other slots map it.
+    unsigned int * _aliases;
+
+    /// For each physical slot, one plus the first slot meshed onto it;
+    /// for each of those, one plus the next (0 ends the chain).
+    unsigned int * _nextAlias;
+
+    /// The pipe whose write end a forked child closes once it has its
+    /// own copy of the file (-1 when not forking).
+    int _forkRead;
+    int _forkWrite;
+
+    /// The process that is forking (0 when none is).
+    volatile pid_t _forkParent;
+
+    /// Whether the fault handler is ours only for the fork, and what
+    /// it chained to before.
+    bool _borrowedHandler;
+    struct sigaction _savedAction;
+
+    /// The range that is currently write-protected.
+    char * volatile _barrierStart;
+    char * volatile _barrierEnd;
+
+    /// The thread that write-protected it.
+    volatile pid_t _barrierOwner;
+
+    /// Whether we have installed our fault handler (see faultHandlerInPlace).
+    bool _handlerInstalled;
+
+    LockType _lock;
+
+  };
+
+
+  /**
+   * @class MeshArena
+   * @brief Route requests to the one mesh arena instance.
+   */
+
+  template <size_t SuperblockSize,
+	    class LockType>
+  class MeshArena : public ExactlyOne<MeshArenaInstance<SuperblockSize, LockType> > {
+  public:
+
+    enum { Alignment = SuperblockSize };
+
+    inline void * malloc (size_t sz) {
+      return (*this)().malloc (sz);
+    }
+    inline void free (void * ptr) {
+      (*this)().free (ptr);
+    }
+    inline size_t getSize (void * ptr) {
+      return (*this)().getSize (ptr);
+    }
+    inline void clear() {
+      (*this)().clear();
+    }
+    inline bool canMesh (void) {
+      return (*this)().canMesh();
+    }
+    inline bool isAliased (void * ptr) {
+      return (*this)().isAliased (ptr);
+    }
+    inline bool isShared (void * ptr) {
+      return (*this)().isShared (ptr);
+    }
+    inline const void * beginMesh (void * drop) {
+      return (*this)().beginMesh (drop);
+    }
+    inline void endMesh (void * keep, void * drop) {
+      (*this)().endMesh (keep, drop);
+    }
+    inline void prepareFork (void) {
+      (*this)().prepareFork();
+    }
+    inline void parentAfterFork (void) {
+      (*this)().parentAfterFork();
+    }
+    inline void childAfterFork (void) {
+      (*this)().childAfterFork();
+    }
+  };
+
+}
+
+#endif
@@ -33,7 +33,7 @@
 
 /**
  * @class MmapAlloc
- * @brief Obtains memory from Mmap but doesn't allow it to be freed.
+ * @brief Obtains memory from Mmap; callers that free it must say how much.
  * @author Emery Berger <http://www.cs.umass.edu/~emery>
  */
 
@@ -49,6 +49,10 @@ namespace Hoard {
       return ptr;
     }
 
+    static void free (void * ptr, size_t sz) {
+      HL::MmapWrapper::unmap (ptr, sz);
+    }
+
   };
   
 }
@@ -0,0 +1,202 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_PAGEMAP_H
+#define HOARD_PAGEMAP_H
+
+#include <stddef.h>
+
+#include "heaplayers.h"
+#include "checkpoweroftwo.h"
+
+namespace Hoard {
+
+  /// The base-2 logarithm of a power of two, at compile time.
+  template <size_t N>
+  class PageMapLog2 {
+  public:
+    enum { VALUE = 1 + PageMapLog2<N / 2>::VALUE };
+  };
+
+  template <>
+  class PageMapLog2<1> {
+  public:
+    enum { VALUE = 0 };
+  };
+
+  /**
+   * @class PageMap
+   * @brief Records, for every ChunkSize-aligned chunk of the address
+   * space, what Hoard keeps there.
+   *
+   * The map is a two-level radix tree: a static root of pointers to
+   * leaves of one byte per chunk, each leaf mapped the first time an
+   * address it covers is marked (and never unmapped). Lookups take no
+   * lock and touch only the map, so that a pointer Hoard never handed
+   * out (or one into memory since unmapped) can be turned away without
+   * reading the chunk it points into.
+   */
+
+  template <size_t ChunkSize>
+  class PageMap {
+  public:
+
+    enum Kind {
+      Foreign = 0,	///< not ours.
+      Superblock = 1,	///< a small-object superblock.
+      BigBlock = 2,	///< the first chunk of a large object.
+      BigBlockTail = 3	///< any other chunk of a large object.
+    };
+
+    /// @brief What is in the chunk that holds ptr.
+    static inline int kindOf (const void * ptr) {
+      const size_t chunk = (size_t) ptr >> ChunkBits;
+      if (chunk >> IndexBits) {
+	// Beyond any address mmap hands out.
+	return Foreign;
+      }
+      const unsigned char * leaf =
+	__atomic_load_n (&_root[chunk >> LeafBits], __ATOMIC_ACQUIRE);
+      if (leaf == NULL) {
+	return Foreign;
+      }
+      return leaf[chunk & (LeafEntries - 1)];
+    }
+
+    /// @brief True iff ptr points into a superblock or the first
+    /// chunk of a large object, where a header can be found by masking.
+    static inline bool isOwned (const void * ptr) {
+      const int k = kindOf (ptr);
+      return (k == Superblock) || (k == BigBlock);
+    }
+
+    /// @brief Mark the chunks of [ptr, ptr+sz): the first as head, the
+    /// rest as tail.
+    /// @return false if no memory was left for the map.
+    static bool mark (void * ptr, size_t sz, Kind head, Kind tail) {
+      size_t chunk = (size_t) ptr >> ChunkBits;
+      const size_t end = ((size_t) ptr + sz + ChunkSize - 1) >> ChunkBits;
+      for (Kind k = head; chunk < end; chunk++, k = tail) {
+	unsigned char * leaf = getLeaf (chunk);
+	if (leaf == NULL) {
+	  return false;
+	}
+	__atomic_store_n (&leaf[chunk & (LeafEntries - 1)], (unsigned char) k, __ATOMIC_RELEASE);
+      }
+      return true;
+    }
+
+    /// @brief Forget the chunks of [ptr, ptr+sz), before they are unmapped.
+    static void clear (void * ptr, size_t sz) {
+      mark (ptr, sz, Foreign, Foreign);
+    }
+
+  private:
+
+    enum { ChunkBits = PageMapLog2<ChunkSize>::VALUE };
+
+    /// How many address bits mmap can hand out (47 for user space on
+    /// x86-64 and ARM64, without asking for more).
+    enum { AddressBits = (sizeof(void *) == 8) ? 48 : 32 };
+
+    enum { IndexBits = AddressBits - ChunkBits };
+
+    /// Each leaf covers 2^LeafBits chunks (64GB of 64K chunks).
+    enum { LeafBits = (IndexBits > 20) ? 20 : IndexBits };
+
+    enum { LeafEntries = 1UL << LeafBits };
+
+    enum { RootEntries = 1UL << (IndexBits - LeafBits) };
+
+    /// @brief The leaf for chunk, mapped if need be.
+    static unsigned char * getLeaf (size_t chunk) {
+      unsigned char * volatile & slot = _root[chunk >> LeafBits];
+      unsigned char * leaf = __atomic_load_n (&slot, __ATOMIC_ACQUIRE);
+      if (leaf == NULL) {
+	// Only the pages of the leaf that get marked become resident.
+	unsigned char * fresh = (unsigned char *) HL::MmapWrapper::map (LeafEntries);
+	if (fresh == NULL) {
+	  return NULL;
+	}
+	if (__sync_bool_compare_and_swap (&slot, (unsigned char *) NULL, fresh)) {
+	  leaf = fresh;
+	} else {
+	  // Someone beat us to it.
+	  HL::MmapWrapper::unmap (fresh, LeafEntries);
+	  leaf = slot;
+	}
+      }
+      return leaf;
+    }
+
+    static unsigned char * volatile _root[RootEntries];
+
+    CheckPowerOfTwo<ChunkSize> verifyPowerOfTwo;
+  };
+
+  template <size_t ChunkSize>
+  unsigned char * volatile PageMap<ChunkSize>::_root[PageMap<ChunkSize>::RootEntries];
+
+
+  /**
+   * @class PageMapHeap
+   * @brief Marks the memory its superheap hands out in the page map,
+   * as Head (and Tail, past its first chunk), until it is freed.
+   */
+
+  template <size_t ChunkSize,
+	    int Head,
+	    int Tail,
+	    class SuperHeap>
+  class PageMapHeap : public SuperHeap {
+  public:
+
+    typedef PageMap<ChunkSize> Map;
+
+    MALLOC_FUNCTION INLINE void * malloc (size_t sz) {
+      void * ptr = SuperHeap::malloc (sz);
+      if (ptr && !Map::mark (ptr, sz, (typename Map::Kind) Head, (typename Map::Kind) Tail)) {
+	// Memory we cannot record would look foreign: give it back.
+	Map::clear (ptr, sz);
+	SuperHeap::free (ptr);
+	ptr = NULL;
+      }
+      return ptr;
+    }
+
+    INLINE void free (void * ptr) {
+      // Forget it first, since the address may be reused the moment
+      // it is unmapped.
+      Map::clear (ptr, SuperHeap::getSize (ptr));
+      SuperHeap::free (ptr);
+    }
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,64 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+/**
+ * @file   prefault.h
+ * @brief  Faults pages in ahead of use.
+ */
+
+#ifndef HOARD_PREFAULT_H
+#define HOARD_PREFAULT_H
+
+#include <cstddef>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+#include "heaplayers.h"
+
+namespace Hoard {
+
+  /// @brief Back [ptr, ptr + sz) with physical pages now, rather than
+  /// on first touch.
+  /// @note  May write zeroes: only use it on memory nothing holds yet.
+  inline void prefault (void * ptr, size_t sz) {
+#if defined(MADV_POPULATE_WRITE)
+    if (madvise (ptr, sz, MADV_POPULATE_WRITE) == 0) {
+      return;
+    }
+#endif
+    // Older kernels: touch every page ourselves.
+    for (size_t i = 0; i < sz; i += HL::MmapWrapper::Size) {
+      ((volatile char *) ptr)[i] = 0;
+    }
+  }
+
+}
+
+#endif
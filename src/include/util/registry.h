@@ -0,0 +1,90 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef HOARD_REGISTRY_H
+#define HOARD_REGISTRY_H
+
+#include <cassert>
+
+#include "heaplayers.h"
+
+namespace Hoard {
+
+  /**
+   * @class Registry
+   * @brief A fixed-size table of every registered instance of a type.
+   *
+   * Entries are added as instances are constructed and never
+   * removed, so this is for objects that live as long as the
+   * process. Hold lock() to walk the table.
+   */
+
+  template <class Type,
+	    class LockType,
+	    int MaxEntries>
+  class Registry {
+  public:
+
+    static void add (Type * t) {
+      HL::Guard<LockType> g (lock());
+      int& n = count();
+      assert (n < MaxEntries);
+      if (n < MaxEntries) {
+	table()[n] = t;
+	n++;
+      }
+    }
+
+    static LockType& lock (void) {
+      static LockType theLock;
+      return theLock;
+    }
+
+    static int size (void) {
+      return count();
+    }
+
+    static Type * get (int i) {
+      return table()[i];
+    }
+
+  private:
+
+    static int& count (void) {
+      static int theCount = 0;
+      return theCount;
+    }
+
+    static Type ** table (void) {
+      static Type * theTable[MaxEntries];
+      return theTable;
+    }
+
+  };
+
+}
+
+#endif
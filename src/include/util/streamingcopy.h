@@ -0,0 +1,199 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/**
+ * @file   streamingcopy.h
+ * @brief  Copies and clears large blocks without filling the caches.
+ *
+ * A copy or clear of a block of many megabytes through the caches
+ * (as memcpy and memset do) evicts everything else from them, though
+ * the program may not touch the block again for a while. Above a
+ * threshold, we instead write with non-temporal (streaming) stores,
+ * which go around the caches to memory, and read the source with
+ * non-temporal prefetches. The widest stores the CPU has (AVX or
+ * SSE2) are chosen at run time. Elsewhere, these are memcpy and memset.
+ */
+
+#ifndef HOARD_STREAMINGCOPY_H
+#define HOARD_STREAMINGCOPY_H
+
+#include <cstddef>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HOARD_STREAMING_STORES 1
+#include <immintrin.h>
+#endif
+
+namespace Hoard {
+
+  template <size_t Threshold>
+  class StreamingCopy {
+  public:
+
+    /// Copy sz bytes from src to dst, which do not overlap.
+    static void copy (void * dst, const void * src, size_t sz) {
+#if HOARD_STREAMING_STORES
+      if (sz >= Threshold) {
+	const int k = kind();
+	if (k != None) {
+	  // Bring dst up to a cache line through the caches; stream the
+	  // lines after it; copy what is left over at the end.
+	  const size_t head = lineGap (dst);
+	  memcpy (dst, src, head);
+	  char * d = (char *) dst + head;
+	  const char * s = (const char *) src + head;
+	  const size_t lines = (sz - head) / LineSize;
+	  if (k == AVX) {
+	    copyLinesAVX (d, s, lines);
+	  } else {
+	    copyLinesSSE2 (d, s, lines);
+	  }
+	  const size_t done = head + lines * LineSize;
+	  memcpy ((char *) dst + done, (const char *) src + done, sz - done);
+	  return;
+	}
+      }
+#endif
+      memcpy (dst, src, sz);
+    }
+
+    /// Set sz bytes at dst to zero.
+    static void zero (void * dst, size_t sz) {
+#if HOARD_STREAMING_STORES
+      if (sz >= Threshold) {
+	const int k = kind();
+	if (k != None) {
+	  const size_t head = lineGap (dst);
+	  memset (dst, 0, head);
+	  char * d = (char *) dst + head;
+	  const size_t lines = (sz - head) / LineSize;
+	  if (k == AVX) {
+	    zeroLinesAVX (d, lines);
+	  } else {
+	    zeroLinesSSE2 (d, lines);
+	  }
+	  const size_t done = head + lines * LineSize;
+	  memset ((char *) dst + done, 0, sz - done);
+	  return;
+	}
+      }
+#endif
+      memset (dst, 0, sz);
+    }
+
+  private:
+
+#if HOARD_STREAMING_STORES
+    enum { LineSize = 64 };
+
+    /// How far ahead of the copy we prefetch the source.
+    enum { PrefetchDistance = 8 * LineSize };
+
+    enum { None, SSE2, AVX };
+
+    /// The widest streaming stores this CPU has, found once.
+    static int kind (void) {
+      static int k = -1;
+      if (k < 0) {
+	// Racy, but every thread finds the same answer.
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports ("avx")) {
+	  k = AVX;
+	} else if (__builtin_cpu_supports ("sse2")) {
+	  k = SSE2;
+	} else {
+	  k = None;
+	}
+      }
+      return k;
+    }
+
+    /// The bytes from ptr to the next cache-line boundary.
+    static size_t lineGap (const void * ptr) {
+      return (LineSize - ((size_t) ptr & (LineSize - 1))) & (LineSize - 1);
+    }
+
+    // The streaming stores are weakly ordered, so each loop ends with
+    // a store fence: whoever we hand the block to must see them all.
+
+    __attribute__((target("sse2")))
+    static void copyLinesSSE2 (char * d, const char * s, size_t lines) {
+      for (size_t i = 0; i < lines; i++, d += LineSize, s += LineSize) {
+	_mm_prefetch (s + PrefetchDistance, _MM_HINT_NTA);
+	const __m128i a = _mm_loadu_si128 ((const __m128i *) s);
+	const __m128i b = _mm_loadu_si128 ((const __m128i *) (s + 16));
+	const __m128i c = _mm_loadu_si128 ((const __m128i *) (s + 32));
+	const __m128i e = _mm_loadu_si128 ((const __m128i *) (s + 48));
+	_mm_stream_si128 ((__m128i *) d, a);
+	_mm_stream_si128 ((__m128i *) (d + 16), b);
+	_mm_stream_si128 ((__m128i *) (d + 32), c);
+	_mm_stream_si128 ((__m128i *) (d + 48), e);
+      }
+      _mm_sfence();
+    }
+
+    __attribute__((target("avx")))
+    static void copyLinesAVX (char * d, const char * s, size_t lines) {
+      for (size_t i = 0; i < lines; i++, d += LineSize, s += LineSize) {
+	_mm_prefetch (s + PrefetchDistance, _MM_HINT_NTA);
+	const __m256i a = _mm256_loadu_si256 ((const __m256i *) s);
+	const __m256i b = _mm256_loadu_si256 ((const __m256i *) (s + 32));
+	_mm256_stream_si256 ((__m256i *) d, a);
+	_mm256_stream_si256 ((__m256i *) (d + 32), b);
+      }
+      _mm_sfence();
+    }
+
+    __attribute__((target("sse2")))
+    static void zeroLinesSSE2 (char * d, size_t lines) {
+      const __m128i z = _mm_setzero_si128();
+      for (size_t i = 0; i < lines; i++, d += LineSize) {
+	_mm_stream_si128 ((__m128i *) d, z);
+	_mm_stream_si128 ((__m128i *) (d + 16), z);
+	_mm_stream_si128 ((__m128i *) (d + 32), z);
+	_mm_stream_si128 ((__m128i *) (d + 48), z);
+      }
+      _mm_sfence();
+    }
+
+    __attribute__((target("avx")))
+    static void zeroLinesAVX (char * d, size_t lines) {
+      const __m256i z = _mm256_setzero_si256();
+      for (size_t i = 0; i < lines; i++, d += LineSize) {
+	_mm256_stream_si256 ((__m256i *) d, z);
+	_mm256_stream_si256 ((__m256i *) (d + 32), z);
+      }
+      _mm_sfence();
+    }
+#endif
+
+  };
+
+}
+
+#endif
@@ -29,20 +29,38 @@
 #define HOARD_THREADPOOLHEAP_H
 
 #include <cassert>
+#include <new>
 
 #include "heaplayers.h"
 #include "array.h"
 //#include "cpuinfo.h"
 
+// Set once the first thread is created (see libhoard.cpp).
+extern volatile bool anyThreadCreated;
+
 namespace Hoard {
 
+  /**
+   * @class ThreadPoolHeap
+   * @brief Maps threads onto a pool of per-thread heaps.
+   *
+   * Heaps are materialized on first use, with memory from HeapSource,
+   * rather than all being built up front: most processes only ever
+   * touch a few of them. Every heap named in the tid map must exist,
+   * so callers materialize a heap before assigning it to a thread.
+   */
+
   template <int NumThreads,
 	    int NumHeaps,
-	    class PerThreadHeap_>
-  class ThreadPoolHeap : public PerThreadHeap_ {
+	    class PerThreadHeap_,
+	    class HeapSource>
+  class ThreadPoolHeap {
   public:
     
     typedef PerThreadHeap_ PerThreadHeap;
+    typedef typename PerThreadHeap::SuperblockType SuperblockType;
+
+    enum { Alignment = PerThreadHeap::Alignment };
     
     enum { MaxThreads = NumThreads };
     enum { NumThreadsMask = NumThreads - 1};
@@ -55,18 +73,42 @@ namespace Hoard {
     
     ThreadPoolHeap (void)
     {
-      // Note: The tidmap values should be set externally.
-      int j = 0;
+      // Every thread starts out on heap 0, and no heap is in use. We
+      // only store into entries that are not already zero, so that
+      // tables in zero-filled static storage are never paged in.
       for (int i = 0; i < NumThreads; i++) {
-	setTidMap(i, j % NumHeaps);
-	j++;
+	if (_tidMap(i) != 0) {
+	  _tidMap(i) = 0;
+	}
       }
+      for (int i = 0; i < NumHeaps; i++) {
+	if (_inUseMap(i) != 0) {
+	  _inUseMap(i) = 0;
+	}
+	if (_heap(i) != NULL) {
+	  _heap(i) = NULL;
+	}
+      }
+      materializeHeap (0);
     }
     
     inline PerThreadHeap& getHeap (void) {
+      if (!anyThreadCreated) {
+	// Sequential mode: the one thread always gets heap 0, so skip
+	// the thread id lookup.
+	return *_heap(0);
+      }
       int tid = HL::CPUInfo::getThreadId();
       int heapno = _tidMap(tid & NumThreadsMask);
-      return _heap(heapno);
+      assert (_heap(heapno) != NULL);
+      return *_heap(heapno);
+    }
+
+    /// @brief The given heap, which must exist (see materializeHeap),
+    /// whichever thread asks.
+    inline PerThreadHeap& getHeap (int heapno) {
+      assert (_heap(heapno) != NULL);
+      return *_heap(heapno);
     }
     
     inline void * malloc (size_t sz) {
@@ -76,6 +118,23 @@ namespace Hoard {
     inline void free (void * ptr) {
       getHeap().free (ptr);
     }
+
+    /// Allocate from the fullest superblock with room (see HoardManager).
+    inline void * mallocDense (size_t sz) {
+      return getHeap().mallocDense (sz);
+    }
+
+    /// @brief Allocate a tiny object (see HoardManager).
+    /// @note  Layers above us round requests up to their alignment,
+    /// so tiny requests come here directly.
+    inline void * mallocTiny (void) {
+      return getHeap().malloc (PerThreadHeap::SuperblockType::Header::TinyObjectSize);
+    }
+    
+    /// Free a batch of objects, each to its owner (see RedirectFree).
+    inline void freeBatch (void ** ptrs, unsigned int n) {
+      PerThreadHeap::freeBatch (ptrs, n);
+    }
     
     inline void clear (void) {
       getHeap().clear();
@@ -85,8 +144,62 @@ namespace Hoard {
       return PerThreadHeap::getSize (ptr);
     }
     
+    /// @brief Build the given heap if it does not exist yet.
+    /// @return false if we are out of memory.
+    /// @note  Callers must serialize this (see HeapManager).
+    bool materializeHeap (int heapno) {
+      assert ((heapno >= 0) && (heapno < MaxHeaps));
+      if (_heap(heapno) != NULL) {
+	return true;
+      }
+      void * buf = _heapSource.malloc (sizeof(PerThreadHeap));
+      if (buf == NULL) {
+	return false;
+      }
+      _heap(heapno) = new (buf) PerThreadHeap;
+      return true;
+    }
+
+    /// Lock every heap that exists, in index order.
+    void lockAll (void) {
+      for (int i = 0; i < MaxHeaps; i++) {
+	if (_heap(i) != NULL) {
+	  _heap(i)->lock();
+	}
+      }
+    }
+
+    void unlockAll (void) {
+      for (int i = MaxHeaps - 1; i >= 0; i--) {
+	if (_heap(i) != NULL) {
+	  _heap(i)->unlock();
+	}
+      }
+    }
+
+    /// Apply f to every superblock held by any heap (see lockAll).
+    template <class Function>
+    void forEachSuperblock (Function& f) {
+      for (int i = 0; i < MaxHeaps; i++) {
+	if (_heap(i) != NULL) {
+	  _heap(i)->forEachSuperblock (f);
+	}
+      }
+    }
+    
+    /// @brief Add up the superblock and in-use bytes of every heap
+    /// that exists, locking each in turn (see HoardManager::getTotals).
+    void getTotals (size_t& allocated, size_t& inUse) {
+      for (int i = 0; i < MaxHeaps; i++) {
+	if (_heap(i) != NULL) {
+	  _heap(i)->getTotals (allocated, inUse);
+	}
+      }
+    }
+
     void setTidMap (int index, int value) {
       assert ((value >= 0) && (value < MaxHeaps));
+      assert (_heap(value) != NULL);
       _tidMap(index) = value;
     }
     
@@ -97,7 +210,23 @@ namespace Hoard {
     void setInusemap (int index, int value) {
       _inUseMap(index) = value;
     }
+
+    /// @brief The calling thread is done with the given heap, so its
+    /// lock should no longer favor it (see BiasedLock).
+    void unbiasHeap (int heapno) {
+      if (_heap(heapno) != NULL) {
+	_heap(heapno)->unbias();
+      }
+    }
     
+    /// @brief Give up the given heap's superblocks, now that no thread
+    /// uses it (see HeapManager::releaseHeap).
+    void releaseHeapMemory (int heapno) {
+      if (_heap(heapno) != NULL) {
+	_heap(heapno)->releaseAll();
+      }
+    }
+
     int getInusemap (int index) const {
       return _inUseMap(index);
     }
@@ -111,8 +240,11 @@ namespace Hoard {
     /// Which heap is in use (a reference count).
     Array<MaxHeaps, int> _inUseMap;
     
-    /// The array of heaps we choose from.
-    Array<MaxHeaps, PerThreadHeap> _heap;
+    /// The heaps we choose from (NULL until first used).
+    Array<MaxHeaps, PerThreadHeap *> _heap;
+    
+    /// Where the heaps themselves come from.
+    HeapSource _heapSource;
     
   };
   
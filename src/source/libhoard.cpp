@@ -33,8 +33,15 @@
 #include "heaplayers.h"
 using namespace HL;
 
+#include <errno.h>
 #include <new>
 
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#endif
+
 // The undef below ensures that any pthread_* calls get strong
 // linkage.  Otherwise, our versions here won't replace them.  It is
 // IMPERATIVE that this line appear before any files get included.
@@ -57,14 +64,22 @@ using namespace HL;
 
 #endif
 
-#if HOARD_NO_LOCK_OPT
-// Disable lock optimization.
+#if HOARD_NO_LOCK_OPT || defined(_WIN32)
+// Disable lock optimization and sequential mode. (Windows does not
+// intercept thread creation, so we never know we are alone.)
 volatile bool anyThreadCreated = true;
 #else
-// The normal case. See heaplayers/spinlock.h.
+// The normal case. Until the first thread is created, the locks skip
+// their atomic operations (see heaplayers/spinlock.h) and Hoard runs
+// in sequential mode (see tlab.h).
 volatile bool anyThreadCreated = false;
 #endif
 
+#if HOARD_MEMORY_PRESSURE
+// Set by the maintenance thread; TLABs hold less as it rises (see tlab.h).
+volatile int hoardMemoryPressure = 0;
+#endif
+
 namespace Hoard {
   
   // HOARD_MMAP_PROTECTION_MASK defines the protection flags used for
@@ -84,7 +99,10 @@ namespace Hoard {
 
 }
 
+#include "hoard.h"
 #include "hoardtlab.h"
+#include "memorypressure.h"
+#include "streamingcopy.h"
 
 //
 // The base Hoard heap.
@@ -104,15 +122,491 @@ HoardHeapType * getMainHoardHeap (void) {
 
   // Now initialize the heap into that buffer.
   static HoardHeapType * th = new (thBuf) HoardHeapType;
+#if HOARD_PREWARM_SUPERBLOCKS
+  // Fault in the global heap before the first allocation returns.
+  static int prewarmed = hoard_prewarm_global (0, HOARD_PREWARM_SUPERBLOCKS);
+  (void) prewarmed;
+#endif
   return th;
 }
 
 TheCustomHeapType * getCustomHeap();
 
+/// Serve the calling thread from heap, until further notice, and
+/// return its TLAB until now (see unixtls.cpp).
+TheCustomHeapType * swapCustomHeap (TheCustomHeapType * heap);
+
+IOBufferPoolType * Hoard::getIOBufferPool (void) {
+  static double poolBuf[sizeof(IOBufferPoolType) / sizeof(double) + 1];
+  static IOBufferPoolType * pool = new (poolBuf) IOBufferPoolType;
+  return pool;
+}
+
+#if HOARD_TLAB_DONATION
+TLABDonationPoolType * Hoard::getTLABDonationPool (void) {
+  static double poolBuf[sizeof(TLABDonationPoolType) / sizeof(double) + 1];
+  static TLABDonationPoolType * pool = new (poolBuf) TLABDonationPoolType;
+  return pool;
+}
+
+HoardTLAB * Hoard::newTLAB (void) {
+  HoardTLAB * tlab = getTLABDonationPool()->adopt();
+  if (tlab == NULL) {
+    void * buf = getMainHoardHeap()->malloc (sizeof(HoardTLAB));
+    tlab = new (buf) HoardTLAB (getMainHoardHeap());
+  }
+  return tlab;
+}
+
+void Hoard::retireTLAB (HoardTLAB * tlab) {
+  // Objects owned by other heaps go back to them now, not whenever
+  // the next thread gets around to it.
+  tlab->flushForeign();
+  tlab->forgetThread();
+  if (!getTLABDonationPool()->donate (tlab)) {
+    tlab->clear();
+    getMainHoardHeap()->free (tlab);
+  }
+}
+
+/// Empty and free every parked TLAB (under memory pressure).
+
+static void drainTLABDonationPool (void) {
+  HoardTLAB * tlab;
+  while ((tlab = getTLABDonationPool()->adopt()) != NULL) {
+    tlab->clear();
+    getMainHoardHeap()->free (tlab);
+  }
+}
+#endif
+
+/// @brief Prewarm heap h for objects of sz bytes, or for every small
+/// size class if sz is 0 (see hoard_prewarm).
+
+template <class Heap>
+static int prewarmHeap (Heap& h, size_t sz, int superblocks) {
+  typedef SizeClasses<TheHeader, SUPERBLOCK_SIZE> Classes;
+  if (sz > BigObjectSize) {
+    return -1;
+  }
+  if (sz == 0) {
+    for (int i = 0; i < (int) Classes::NUM_BINS; i++) {
+      if (!h.prewarm (Classes::getClassSize (i), superblocks)) {
+	return -1;
+      }
+    }
+    return 0;
+  }
+  // malloc rounds small requests up to the alignment before they
+  // reach the heaps (only hoard_malloc_small gets tiny objects).
+  sz = HL::align<TheHeader::Alignment> (sz);
+  return h.prewarm (sz, superblocks) ? 0 : -1;
+}
+
+/// @brief Move the calling thread to heap id, or to a private heap if
+/// id is -1 (see HeapManager::bindHeap).
+/// @return the heap, or -1 on failure (when the thread stays put).
+
+static int bindThreadHeap (int id) {
+  TheCustomHeapType * tlab = getCustomHeap();
+  // Objects cached from the old heap go back to it. Sequential mode
+  // (see tlab.h) would keep allocating from heap 0, so end it, as
+  // creating a thread would.
+  tlab->clear();
+  anyThreadCreated = true;
+  const bool wasPrivate = (tlab->getPrivateHeapIndex() != 0);
+  const int previous = tlab->takeHeapIndex();
+  const int heapIndex = getMainHoardHeap()->bindHeap (id, previous);
+  if (heapIndex < 0) {
+    tlab->setHeapIndex (previous, wasPrivate);
+  } else {
+    // A private heap is ours alone, so the TLAB allocates from it
+    // directly (see HeapManager::bindHeap).
+    tlab->setHeapIndex (heapIndex, id == -1);
+  }
+  return heapIndex;
+}
+
+/// @brief An allocation context (see hoard_context_create): a TLAB
+/// of its own, which also remembers what the thread in it used before
+/// it entered, and a reference on a heap.
+
+struct hoard_context {
+
+  explicit hoard_context (int heapIndex)
+    : tlab (getMainHoardHeap()),
+      heap (heapIndex)
+  {}
+
+  TheCustomHeapType tlab;
+  const int heap;
+
+};
+
+/// @brief Leave every allocation context that the thread served by
+/// tlab is in, innermost first, without touching the thread's own
+/// TLAB pointer (the caller sets that, if it still can).
+/// @return the thread's own TLAB.
+
+TheCustomHeapType * hoardLeaveContexts (TheCustomHeapType * tlab) {
+  TheCustomHeapType * outer;
+  while ((outer = tlab->getOuter()) != NULL) {
+    getMainHoardHeap()->switchHeap (tlab->getOuterHeap());
+    tlab->setOuter (NULL, 0);
+    tlab = outer;
+  }
+  return tlab;
+}
+
+/// An arena (see hoard_arena_create).
+
+struct hoard_arena {
+  ArenaHeap heap;
+};
+
+/// Allocate sz bytes, at most BigObjectSize, from arena.
+
+static void * arenaMalloc (ArenaHeap * arena, size_t sz) {
+  // As the TLAB does: only hoard_malloc_small hands out tiny objects.
+  if (sz < TheHeader::Alignment) {
+    sz = TheHeader::Alignment;
+  }
+  HL::Guard<ArenaHeap> g (*arena);
+  return arena->malloc (sz);
+}
+
+//
+// Maintenance: trimming memory and gathering statistics off the
+// allocation path, on a thread of its own (see hoard_maintenance_start).
+//
+
+#if HOARD_MAINTENANCE_INTERVAL
+/// Ask idle threads to flush their TLABs (see HoardTLAB::noteIdle).
+extern void hoardNoteIdleTLABs (void);
+#endif
+
+/// Held throughout a maintenance pass, and around fork() (see
+/// xxmalloc_lock), so that a child never inherits a pass half-done.
+
+static TheLockType& getMaintenanceLock (void) {
+  static TheLockType theLock;
+  return theLock;
+}
+
+/// What tells the maintenance thread how close we are to running
+/// out of memory (see hoard_watch_memory_pressure).
+
+static MemoryPressure& getMemoryPressure (void) {
+  static double buf[sizeof(MemoryPressure) / sizeof(double) + 1];
+  static MemoryPressure * thePressure = new (buf) MemoryPressure;
+#if HOARD_MEMORY_PRESSURE
+  // Watch our own cgroup unless told otherwise.
+  static bool watching = thePressure->watch (NULL);
+  (void) watching;
+#endif
+  return *thePressure;
+}
+
+static hoard_stats& getLastStats (void) {
+  static hoard_stats theStats;
+  return theStats;
+}
+
+static void gatherStats (hoard_stats& stats) {
+  stats.heap_bytes = 0;
+  stats.heap_in_use_bytes = 0;
+  getMainHoardHeap()->getTotals (stats.heap_bytes, stats.heap_in_use_bytes);
+  stats.global_bytes = 0;
+  stats.global_in_use_bytes = 0;
+  TheGlobalHeap().getTotals (stats.global_bytes, stats.global_in_use_bytes);
+  stats.global_heap_trips = TheGlobalHeap().getTransferTrips();
+}
+
+/// One maintenance pass: give back memory nobody has asked for since
+/// the last pass (or, under memory pressure, all we can), then
+/// refresh the statistics.
+
+static void hoardMaintain (void) {
+  {
+    HL::Guard<TheLockType> g (getMaintenanceLock());
+    hoard_stats& stats = getLastStats();
+    const int pressure = getMemoryPressure().level();
+    stats.memory_pressure = pressure;
+#if HOARD_MEMORY_PRESSURE
+    hoardMemoryPressure = pressure;
+#endif
+    stats.released_superblocks += TheGlobalHeap().releaseEmpty (pressure > MemoryPressure::None);
+#if HOARD_MESH
+    TheGlobalHeap().mesh();
+#endif
+    BigHeapShard::decayAll (pressure);
+#if HOARD_TLAB_DONATION
+    if (pressure > MemoryPressure::None) {
+      drainTLABDonationPool();
+    }
+#endif
+    gatherStats (stats);
+    stats.maintenance_passes++;
+  }
+#if HOARD_MAINTENANCE_INTERVAL
+  // Outside the pass lock: fork() takes the TLAB table lock first.
+  hoardNoteIdleTLABs();
+#endif
+}
+
+#if !defined(_WIN32)
+
+/**
+ * @class MaintenanceThread
+ * @brief The thread that runs hoardMaintain every interval, until
+ * told to stop.
+ */
+
+class MaintenanceThread {
+public:
+
+  MaintenanceThread (void)
+  {
+    init();
+  }
+
+  int start (unsigned int intervalMs) {
+    if (intervalMs == 0) {
+      return -1;
+    }
+    pthread_mutex_lock (&_mutex);
+    _intervalMs = intervalMs;
+    _everStarted = true;
+    int result = 0;
+    if (_running) {
+      // Wake it up, so that the new interval applies now.
+      pthread_cond_signal (&_wakeup);
+    } else {
+      _stopping = false;
+      if (pthread_create (&_thread, NULL, run, this) == 0) {
+	_running = true;
+	if (!_stopAtExit) {
+	  _stopAtExit = true;
+	  atexit (stopAtExit);
+	}
+      } else {
+	result = -1;
+      }
+    }
+    pthread_mutex_unlock (&_mutex);
+    return result;
+  }
+
+  void stop (void) {
+    pthread_mutex_lock (&_mutex);
+    if (!_running || _stopping) {
+      pthread_mutex_unlock (&_mutex);
+      return;
+    }
+    _stopping = true;
+    pthread_cond_signal (&_wakeup);
+    pthread_mutex_unlock (&_mutex);
+    pthread_join (_thread, NULL);
+    pthread_mutex_lock (&_mutex);
+    _running = false;
+    _stopping = false;
+    pthread_mutex_unlock (&_mutex);
+  }
+
+  bool isRunning (void) {
+    return _running;
+  }
+
+  bool everStarted (void) {
+    return _everStarted;
+  }
+
+  /// @brief Start at the interval we last ran at (or else the one
+  /// given), unless we have been started before.
+  void startOnce (unsigned int intervalMs) {
+    if (!_everStarted) {
+      start (_intervalMs ? _intervalMs : intervalMs);
+    }
+  }
+
+  /// In a forked child, which has no maintenance thread. If the
+  /// parent's was running, the child starts its own the same way the
+  /// parent did (see hoardStartMaintenance); if the parent stopped
+  /// it, it stays stopped.
+  void afterForkChild (void) {
+    const bool stopped = _everStarted && !_running;
+    const unsigned int intervalMs = _intervalMs;
+    const bool stopAtExit = _stopAtExit;
+    init();
+    _everStarted = stopped;
+    _intervalMs = intervalMs;
+    _stopAtExit = stopAtExit;
+  }
+
+  static MaintenanceThread& instance (void) {
+    static double buf[sizeof(MaintenanceThread) / sizeof(double) + 1];
+    static MaintenanceThread * theThread = new (buf) MaintenanceThread;
+    return *theThread;
+  }
+
+private:
+
+  void init (void) {
+    pthread_mutex_init (&_mutex, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init (&attr);
+#if !defined(__APPLE__)
+    pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init (&_wakeup, &attr);
+    pthread_condattr_destroy (&attr);
+    _intervalMs = 0;
+    _running = false;
+    _stopping = false;
+    _everStarted = false;
+    _stopAtExit = false;
+  }
+
+  static void stopAtExit (void) {
+    instance().stop();
+  }
+
+  static void * run (void * arg) {
+    MaintenanceThread * m = (MaintenanceThread *) arg;
+    pthread_mutex_lock (&m->_mutex);
+    while (!m->_stopping) {
+      if (m->sleep() == ETIMEDOUT) {
+	pthread_mutex_unlock (&m->_mutex);
+	hoardMaintain();
+	pthread_mutex_lock (&m->_mutex);
+      }
+    }
+    pthread_mutex_unlock (&m->_mutex);
+    return NULL;
+  }
+
+  /// Wait for the interval to pass, or to be woken.
+  int sleep (void) {
+    struct timespec t;
+#if defined(__APPLE__)
+    // No monotonic clock for condition variables here.
+    clock_gettime (CLOCK_REALTIME, &t);
+#else
+    clock_gettime (CLOCK_MONOTONIC, &t);
+#endif
+    t.tv_sec += _intervalMs / 1000;
+    t.tv_nsec += (long) (_intervalMs % 1000) * 1000000L;
+    if (t.tv_nsec >= 1000000000L) {
+      t.tv_sec++;
+      t.tv_nsec -= 1000000000L;
+    }
+    return pthread_cond_timedwait (&_wakeup, &_mutex, &t);
+  }
+
+  pthread_mutex_t _mutex;
+  pthread_cond_t _wakeup;
+  pthread_t _thread;
+  unsigned int _intervalMs;
+  volatile bool _running;
+  bool _stopping;
+  volatile bool _everStarted;
+  bool _stopAtExit;
+
+};
+
+#if HOARD_MAINTENANCE_INTERVAL
+/// @brief Start maintenance with the built-in interval, unless it has
+/// been started before. Each new thread calls this on its way in
+/// (see startMeUp in unixtls.cpp), outside pthread_create; so does
+/// the maintenance thread itself, which finds it already started.
+
+void hoardStartMaintenance (void) {
+  MaintenanceThread::instance().startOnce (HOARD_MAINTENANCE_INTERVAL);
+}
+#endif
+
+#endif
+
+// Superblock locks are too many to take around fork(), so a forked
+// child releases any that a thread which did not survive was holding.
+
+class ResetSuperblockLock {
+public:
+  template <class SuperblockType>
+  void operator() (SuperblockType * s) {
+    s->resetLock();
+  }
+};
+
+/// In a forked child, holding the global and main heap locks: let go
+/// of the superblocks that threads which did not survive were in.
+
+static void resetSuperblockLocks (TheGlobalHeap& globalHeap) {
+  ResetSuperblockLock reset;
+  globalHeap.forEachSuperblock (reset);
+  getMainHoardHeap()->forEachSuperblock (reset);
+}
+
+/// In a forked child, with no locks held: forget the heaps of the
+/// threads that did not survive, and the maintenance thread. The one
+/// that did survive keeps its private heap, if it has one.
+
+static void resetThreadState (int privateHeap) {
+  getMainHoardHeap()->resetAfterFork (privateHeap);
+#if !defined(_WIN32)
+  MaintenanceThread::instance().afterForkChild();
+#endif
+}
+
+/// In a forked child: release everything xxmalloc_lock took, and
+/// forget about the threads that did not survive (see unixtls.cpp).
+
+void hoardAfterForkChild (int privateHeap) {
+  MmapSource().unlock();
+#if HOARD_MESH
+  // Superblocks are shared mappings of a memory file, so the child
+  // moves to its own copy of that file (see mesharena.h).
+  SuperblockSource().childAfterFork();
+#endif
+#if HOARD_ADDRESS_WINDOW
+  CompactWindow().unlock();
+#endif
+  getIOBufferPool()->unlock();
+#if HOARD_TLAB_DONATION
+  getTLABDonationPool()->unlock();
+#endif
+  BigHeapLock::unlockAll();
+  TheGlobalHeap globalHeap;
+  resetSuperblockLocks (globalHeap);
+  globalHeap.unlock();
+  getMainHoardHeap()->unlock();
+  getMaintenanceLock().unlock();
+  resetThreadState (privateHeap);
+}
+
+/// In a forked child whose locks the system's malloc has already
+/// released, by calling xxmalloc_unlock through the zone's unlock
+/// hook (as on the Mac): just forget about the threads that did not
+/// survive (see mactls.cpp).
+
+void hoardResetAfterFork (int privateHeap) {
+  TheGlobalHeap globalHeap;
+  globalHeap.lock();
+  getMainHoardHeap()->lock();
+  resetSuperblockLocks (globalHeap);
+  getMainHoardHeap()->unlock();
+  globalHeap.unlock();
+  resetThreadState (privateHeap);
+}
+
 extern "C" {
 
   void * xxmalloc (size_t sz) {
     TheCustomHeapType * h = getCustomHeap();
+    ArenaHeap * arena = h->getArena();
+    if ((arena != NULL) && (sz <= BigObjectSize)) {
+      return arenaMalloc (arena, sz);
+    }
     void * ptr = h->malloc (sz);
     return ptr;
   }
@@ -125,12 +619,335 @@ extern "C" {
     return getCustomHeap()->getSize (ptr);
   }
 
+  void * hoard_malloc_small (size_t sz) {
+    if (sz > TheHeader::TinyObjectSize) {
+      return xxmalloc (sz);
+    }
+    return getCustomHeap()->mallocTiny();
+  }
+
+  void * hoard_io_malloc (size_t sz) {
+    return getCustomHeap()->getIOBuffers().malloc (sz);
+  }
+
+  void hoard_io_free (void * ptr) {
+    getCustomHeap()->getIOBuffers().free (ptr);
+  }
+
+  void * hoard_io_realloc (void * ptr, size_t sz) {
+    return getCustomHeap()->getIOBuffers().realloc (ptr, sz);
+  }
+
+  void * hoard_malloc_isolated (size_t sz) {
+    // Round up to whole cache lines. Objects in a size class of whole
+    // lines start on a line (see HoardSuperblock), and so do big
+    // objects (see AddHeaderHeap), so they never share one with
+    // another object.
+    const size_t lines = (sz == 0) ? 1 : (sz + CacheLineSize - 1) / CacheLineSize;
+    const size_t n = lines * CacheLineSize;
+    typedef SizeClasses<TheHeader, SUPERBLOCK_SIZE> Classes;
+    if ((n <= BigObjectSize) && (Classes::getClassSize (Classes::getSizeClass (n)) == n)) {
+      void * ptr = xxmalloc (n);
+      assert ((size_t) ptr % CacheLineSize == 0);
+      return ptr;
+    }
+    const size_t padded = n + CacheLineSize - TheHeader::Alignment;
+    if (padded <= BigObjectSize) {
+      // No size class fits exactly, so carve the lines out of a larger
+      // small object. Small superblocks normalize interior pointers on
+      // every free path.
+      char * ptr = (char *) xxmalloc (padded);
+      if (ptr == NULL) {
+	return NULL;
+      }
+      return (void *) HL::align<CacheLineSize> ((size_t) ptr);
+    }
+    // Big objects are line-aligned as they are; hand one out unchanged,
+    // since the big-object heap finds its header just before the pointer.
+    void * ptr = xxmalloc ((n > BigObjectSize) ? n : BigObjectSize + 1);
+    assert (((size_t) ptr % CacheLineSize) == 0);
+    return ptr;
+  }
+
+  void * hoard_realloc (void * ptr, size_t sz) {
+    if (ptr == NULL) {
+      return xxmalloc (sz);
+    }
+    const size_t oldSize = xxmalloc_usable_size (ptr);
+    if (oldSize == 0) {
+      // Not one of ours, so we can't tell how much of it to keep:
+      // fail, and leave it alone.
+      errno = ENOMEM;
+      return NULL;
+    }
+    if ((sz <= oldSize) && (sz > oldSize / 2)) {
+      // It still fits, and wastes less than half.
+      return ptr;
+    }
+    void * buf = xxmalloc (sz);
+    if (buf != NULL) {
+      StreamingCopy<StreamingThreshold>::copy (buf, ptr, (oldSize < sz) ? oldSize : sz);
+      xxfree (ptr);
+    }
+    return buf;
+  }
+
+  void * hoard_calloc (size_t n, size_t sz) {
+    const size_t total = n * sz;
+    if ((sz != 0) && (total / sz != n)) {
+      // Overflow.
+      return NULL;
+    }
+    void * ptr = xxmalloc (total);
+    if ((ptr != NULL) &&
+	!((total > BigObjectSize) && objectSource::isFresh (ptr))) {
+      // Large objects that come straight from mmap are zero already.
+      StreamingCopy<StreamingThreshold>::zero (ptr, total);
+    }
+    return ptr;
+  }
+
+  int hoard_prewarm (size_t sz, int superblocks) {
+    TheCustomHeapType * tlab = getCustomHeap();
+    if (tlab->getPrivateHeapIndex() != 0) {
+      return prewarmHeap (tlab->getPrivateHeap(), sz, superblocks);
+    }
+    return prewarmHeap (getMainHoardHeap()->getHeap(), sz, superblocks);
+  }
+
+  int hoard_prewarm_global (size_t sz, int superblocks) {
+    TheGlobalHeap globalHeap;
+    return prewarmHeap (globalHeap, sz, superblocks);
+  }
+
+  int hoard_defrag_hint (void * ptr) {
+    if (ptr == NULL) {
+      return 0;
+    }
+    if (!SmallSuperblockType::isOwned (ptr)) {
+      return 0;
+    }
+    SmallSuperblockType * s = SmallSuperblockType::getSuperblock (ptr);
+    if (s->getObjectSize() > BigObjectSize) {
+      // Not ours, or a large object (which has its own superblock).
+      return 0;
+    }
+    // The superblock may move to another heap (even the global heap,
+    // whose heap type differs) while we look, but every heap stays
+    // valid, and the owner's kind tells us its type.
+    return PerThreadHoardHeap::isSparse (ptr);
+  }
+
+  void * hoard_malloc_no_tcache (size_t sz) {
+    if (sz > BigObjectSize) {
+      // Large objects never pass through the TLAB.
+      return xxmalloc (sz);
+    }
+    // Round up as malloc does before it reaches the heaps.
+    sz = (sz < TheHeader::Alignment) ? (size_t) TheHeader::Alignment : HL::align<TheHeader::Alignment> (sz);
+    TheCustomHeapType * tlab = getCustomHeap();
+    if (tlab->getPrivateHeapIndex() != 0) {
+      return tlab->getPrivateHeap().mallocDense (sz);
+    }
+    return getMainHoardHeap()->mallocDense (sz);
+  }
+
+  void hoard_free_no_tcache (void * ptr) {
+    getMainHoardHeap()->free (ptr);
+  }
+
+  int hoard_maintenance_start (unsigned int intervalMs) {
+#if defined(_WIN32)
+    (void) intervalMs;
+    return -1;
+#else
+    return MaintenanceThread::instance().start (intervalMs);
+#endif
+  }
+
+  void hoard_maintenance_stop (void) {
+#if !defined(_WIN32)
+    MaintenanceThread::instance().stop();
+#endif
+  }
+
+  int hoard_watch_memory_pressure (const char * cgroupDir) {
+    MemoryPressure& p = getMemoryPressure();
+    HL::Guard<TheLockType> g (getMaintenanceLock());
+    return p.watch (cgroupDir) ? 0 : -1;
+  }
+
+  void hoard_get_stats (struct hoard_stats * stats) {
+    MemoryPressure& p = getMemoryPressure();
+    HL::Guard<TheLockType> g (getMaintenanceLock());
+    *stats = getLastStats();
+#if !defined(_WIN32)
+    if (MaintenanceThread::instance().isRunning()) {
+      return;
+    }
+#endif
+    // No pass will sample the pressure for us, so do it now.
+    stats->memory_pressure = p.level();
+    gatherStats (*stats);
+  }
+
+  int hoard_set_heap (int id) {
+    if (id < 0) {
+      return -1;
+    }
+    return bindThreadHeap (id) < 0 ? -1 : 0;
+  }
+
+  int hoard_get_heap (void) {
+    const int privateHeap = getCustomHeap()->getPrivateHeapIndex();
+    return privateHeap ? privateHeap : getMainHoardHeap()->getHeapIndex();
+  }
+
+  int hoard_private_heap (void) {
+    return bindThreadHeap (-1);
+  }
+
+  struct hoard_context * hoard_context_create (int id) {
+    if (id < -1) {
+      return NULL;
+    }
+    if (!anyThreadCreated) {
+      // Sequential mode would serve every allocation from heap 0, so
+      // end it, as creating a thread would (see bindThreadHeap).
+      getCustomHeap()->clear();
+      anyThreadCreated = true;
+    }
+    const int heapIndex = getMainHoardHeap()->acquireHeap (id);
+    if (heapIndex < 0) {
+      return NULL;
+    }
+    void * buf = getMainHoardHeap()->malloc (sizeof(hoard_context));
+    if (buf == NULL) {
+      getMainHoardHeap()->dropHeapReference (heapIndex);
+      return NULL;
+    }
+    return new (buf) hoard_context (heapIndex);
+  }
+
+  void hoard_context_enter (struct hoard_context * ctx) {
+    TheCustomHeapType * outer = swapCustomHeap (&ctx->tlab);
+    ctx->tlab.setOuter (outer, getMainHoardHeap()->switchHeap (ctx->heap));
+  }
+
+  void hoard_context_leave (struct hoard_context * ctx) {
+    TheCustomHeapType * outer = ctx->tlab.getOuter();
+    getMainHoardHeap()->switchHeap (ctx->tlab.getOuterHeap());
+    ctx->tlab.setOuter (NULL, 0);
+    swapCustomHeap (outer);
+  }
+
+  void hoard_context_destroy (struct hoard_context * ctx) {
+    if (ctx == NULL) {
+      return;
+    }
+    const int heapIndex = ctx->heap;
+    ctx->tlab.clear();
+    ctx->~hoard_context();
+    getMainHoardHeap()->free (ctx);
+    getMainHoardHeap()->dropHeapReference (heapIndex);
+  }
+
+  struct hoard_arena * hoard_arena_create (void) {
+    void * buf = getMainHoardHeap()->malloc (sizeof(hoard_arena));
+    if (buf == NULL) {
+      return NULL;
+    }
+    return new (buf) hoard_arena;
+  }
+
+  int hoard_arena_push (struct hoard_arena * arena) {
+    return getCustomHeap()->pushArena (&arena->heap) ? 0 : -1;
+  }
+
+  void hoard_arena_pop (void) {
+    getCustomHeap()->popArena();
+  }
+
+  struct hoard_arena * hoard_arena_create_compact (void) {
+#if HOARD_ADDRESS_WINDOW
+    if (hoard_compact_base() == NULL) {
+      return NULL;
+    }
+    struct hoard_arena * arena = hoard_arena_create();
+    if (arena != NULL) {
+      arena->heap.getParentHeap().setCompact();
+    }
+    return arena;
+#else
+    // Without a window (as on 64-bit Windows), only 32-bit builds can
+    // keep the promise: every address fits in 32 bits already.
+    if (sizeof(void *) == 4) {
+      return hoard_arena_create();
+    }
+    return NULL;
+#endif
+  }
+
+  void * hoard_compact_base (void) {
+#if HOARD_ADDRESS_WINDOW
+    return CompactWindow().base();
+#else
+    return NULL;
+#endif
+  }
+
+  void * hoard_arena_malloc (struct hoard_arena * arena, size_t sz) {
+    if (sz > BigObjectSize) {
+      return NULL;
+    }
+    return arenaMalloc (&arena->heap, sz);
+  }
+
+  void hoard_arena_destroy (struct hoard_arena * arena) {
+    if (arena == NULL) {
+      return;
+    }
+    arena->heap.discardAll();
+    arena->~hoard_arena();
+    getMainHoardHeap()->free (arena);
+  }
+
+  /// Take every allocator lock, outermost first, so that no other
+  /// thread is inside Hoard (e.g., around fork()).
   void xxmalloc_lock() {
-    // Undefined for Hoard.
+    getMaintenanceLock().lock();
+    getMainHoardHeap()->lock();
+    TheGlobalHeap().lock();
+    BigHeapLock::lockAll();
+    getIOBufferPool()->lock();
+#if HOARD_ADDRESS_WINDOW
+    CompactWindow().lock();
+#endif
+#if HOARD_TLAB_DONATION
+    getTLABDonationPool()->lock();
+#endif
+#if HOARD_MESH
+    SuperblockSource().prepareFork();
+#endif
+    MmapSource().lock();
   }
 
   void xxmalloc_unlock() {
-    // Undefined for Hoard.
+    MmapSource().unlock();
+#if HOARD_MESH
+    SuperblockSource().parentAfterFork();
+#endif
+#if HOARD_TLAB_DONATION
+    getTLABDonationPool()->unlock();
+#endif
+#if HOARD_ADDRESS_WINDOW
+    CompactWindow().unlock();
+#endif
+    getIOBufferPool()->unlock();
+    BigHeapLock::unlockAll();
+    TheGlobalHeap().unlock();
+    getMainHoardHeap()->unlock();
+    getMaintenanceLock().unlock();
   }
 
 }
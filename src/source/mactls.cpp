@@ -35,6 +35,10 @@ using namespace Hoard;
 
 extern HoardHeapType * getMainHoardHeap (void);
 
+// A thread that exits inside allocation contexts leaves them first
+// (see libhoard.cpp), so that its own TLAB is the one torn down.
+extern TheCustomHeapType * hoardLeaveContexts (TheCustomHeapType * tlab);
+
 #include <pthread.h>
 
 static pthread_key_t theHeapKey;
@@ -44,12 +48,20 @@ static pthread_once_t key_once = PTHREAD_ONCE_INIT;
 // TLAB and then reclaims the memory allocated to hold it.
 
 static void deleteThatHeap (void * p) {
-  TheCustomHeapType * heap = (TheCustomHeapType *) p;
+  // The key holds the TLAB we were last served from, which belongs to
+  // a context if we exited inside one.
+  TheCustomHeapType * heap = hoardLeaveContexts ((TheCustomHeapType *) p);
+  int heapIndex = heap->takeHeapIndex();
+#if HOARD_TLAB_DONATION
+  // Hand the TLAB, full, to the next thread to start.
+  retireTLAB (heap);
+#else
   heap->clear();
   getMainHoardHeap()->free ((void *) heap);
+#endif
   
   // Relinquish the assigned heap.
-  getMainHoardHeap()->releaseHeap();
+  getMainHoardHeap()->releaseHeap (heapIndex);
 }
 
 static void make_heap_key (void)
@@ -77,9 +89,13 @@ static TheCustomHeapType * initializeCustomHeap (void)
   if (heap == NULL) {
     // Defensive programming in case this is called twice.
     // Allocate a per-thread heap.
+#if HOARD_TLAB_DONATION
+    heap = newTLAB();
+#else
     size_t sz = sizeof(TheCustomHeapType);
     void * mh = getMainHoardHeap()->malloc(sz);
     heap = new ((char *) mh) TheCustomHeapType (getMainHoardHeap());
+#endif
     // Store it in the appropriate thread-local area.
     pthread_setspecific (theHeapKey, (void *) heap);
   }
@@ -97,6 +113,23 @@ TheCustomHeapType * getCustomHeap (void) {
   return heap;
 }
 
+// Serve this thread from another TLAB (see hoard_context_enter).
+
+TheCustomHeapType * swapCustomHeap (TheCustomHeapType * heap) {
+  TheCustomHeapType * previous = getCustomHeap();
+  pthread_setspecific (theHeapKey, (void *) heap);
+  return previous;
+}
+
+
+#if HOARD_MAINTENANCE_INTERVAL
+// We keep no table of TLABs here, so idle ones are not flushed early
+// (see unixtls.cpp).
+
+void hoardNoteIdleTLABs() {}
+
+extern void hoardStartMaintenance();
+#endif
 
 //
 // Intercept thread creation and destruction to flush the TLABs.
@@ -112,21 +145,36 @@ extern "C" {
 
 // A special routine we call on thread exits to free up some resources.
 static void exitRoutine (void) {
-  TheCustomHeapType * heap = getCustomHeap();
+  // Go back to this thread's own TLAB, out of any contexts.
+  TheCustomHeapType * current = getCustomHeap();
+  TheCustomHeapType * own = hoardLeaveContexts (current);
+  if (own != current) {
+    pthread_setspecific (theHeapKey, (void *) own);
+  }
+#if HOARD_TLAB_DONATION
+  // Nothing more to do yet: once this thread is gone, its TLAB goes,
+  // full, to another thread, and only then do we relinquish the heap
+  // (see deleteThatHeap).
+#else
+  TheCustomHeapType * heap = own;
 
   // Clear the TLAB's buffer.
   heap->clear();
 
   // Relinquish the assigned heap.
-  getMainHoardHeap()->releaseHeap();
+  getMainHoardHeap()->releaseHeap (heap->takeHeapIndex());
+#endif
 }
 
 extern "C" {
 
   static inline void * startMeUp (void * a)
   {
-    getCustomHeap();
-    getMainHoardHeap()->findUnusedHeap();
+    getCustomHeap()->setHeapIndex ((int) getMainHoardHeap()->findUnusedHeap());
+#if HOARD_MAINTENANCE_INTERVAL
+    // Started here rather than inside pthread_create (see unixtls.cpp).
+    hoardStartMaintenance();
+#endif
     pair<threadFunctionType, void *> * z
       = (pair<threadFunctionType, void *> *) a;
     
@@ -148,6 +196,50 @@ extern "C" {
 extern volatile bool anyThreadCreated;
 
 
+// Called before creating a thread. The first time, this ends
+// sequential mode: the TLAB holds more while we are alone (see
+// tlab.h), so flush it before anyone else can allocate.
+
+static void endSequentialMode() {
+  if (!anyThreadCreated) {
+    getCustomHeap()->clear();
+    anyThreadCreated = true;
+  }
+}
+
+//
+// Make fork() safe. The system's malloc takes and releases Hoard's
+// locks around fork() itself, through the zone's lock hooks (which
+// call xxmalloc_lock and xxmalloc_unlock), in parent and child alike;
+// so here the child only forgets the threads that did not survive.
+// Their TLABs hang off their own thread-specific data, which the
+// child never reaches, so they are abandoned along with whatever
+// they held (see childAfterFork in unixtls.cpp).
+//
+
+extern void hoardResetAfterFork (int privateHeap);
+
+static void childAfterFork() {
+  TheCustomHeapType * mine =
+    (TheCustomHeapType *) pthread_getspecific (theHeapKey);
+  // Inside allocation contexts, our own TLAB is the outermost.
+  while ((mine != NULL) && (mine->getOuter() != NULL)) {
+    mine = mine->getOuter();
+  }
+  hoardResetAfterFork (mine ? mine->getPrivateHeapIndex() : 0);
+#if !HOARD_NO_LOCK_OPT
+  // The child has exactly one thread again.
+  anyThreadCreated = false;
+#endif
+}
+
+static void registerForkHandlers() __attribute__((constructor));
+
+static void registerForkHandlers() {
+  pthread_atfork (NULL, NULL, childAfterFork);
+}
+
+
 // Intercept thread creation. We need this to first associate
 // a heap with the thread and instantiate the thread-specific heap
 // (TLAB).  When the thread ends, we relinquish the assigned heap and
@@ -170,7 +262,7 @@ extern "C" int xxpthread_create (pthread_t *thread,
   // Force initialization of the TLAB before our first thread is created.
   static TheCustomHeapType * t = getCustomHeap();
 
-  anyThreadCreated = true;
+  endSequentialMode();
 
   pair<threadFunctionType, void *> * args =
     new (t->malloc (sizeof(pair<threadFunctionType, void *>)))
@@ -38,9 +38,7 @@
 #define USE_THREAD_KEYWORD 1
 #endif
 
-#if !defined(USE_THREAD_KEYWORD)
 #include <pthread.h>
-#endif
 
 #if defined(__SVR4)
 #include <dlfcn.h>
@@ -62,6 +60,63 @@
 
 extern Hoard::HoardHeapType * getMainHoardHeap();
 
+//
+// Every thread's TLAB, so that maintenance can flush idle ones, and a
+// forked child can forget those of threads that did not survive.
+//
+
+static TheLockType& tlabTableLock() {
+  static TheLockType theLock;
+  return theLock;
+}
+
+static TheCustomHeapType * allTLABs[Hoard::MaxThreads];
+
+static void registerTLAB(TheCustomHeapType * heap) {
+  HL::Guard<TheLockType> g (tlabTableLock());
+  int freeSlot = -1;
+  for (int i = 0; i < Hoard::MaxThreads; i++) {
+    if (allTLABs[i] == heap) {
+      return;
+    }
+    if ((allTLABs[i] == NULL) && (freeSlot < 0)) {
+      freeSlot = i;
+    }
+  }
+  // If the table is full, this TLAB simply is not reclaimed after a fork.
+  if (freeSlot >= 0) {
+    allTLABs[freeSlot] = heap;
+  }
+}
+
+static void unregisterTLAB(TheCustomHeapType * heap) {
+  HL::Guard<TheLockType> g (tlabTableLock());
+  for (int i = 0; i < Hoard::MaxThreads; i++) {
+    if (allTLABs[i] == heap) {
+      allTLABs[i] = NULL;
+    }
+  }
+}
+
+#if HOARD_MAINTENANCE_INTERVAL
+// Called by the maintenance thread once a pass (see libhoard.cpp).
+
+void hoardNoteIdleTLABs() {
+  HL::Guard<TheLockType> g (tlabTableLock());
+  for (int i = 0; i < Hoard::MaxThreads; i++) {
+    if (allTLABs[i] != NULL) {
+      allTLABs[i]->noteIdle();
+    }
+  }
+}
+
+extern void hoardStartMaintenance();
+#endif
+
+// A thread that exits inside allocation contexts leaves them first
+// (see libhoard.cpp), so that its own TLAB is the one torn down.
+extern TheCustomHeapType * hoardLeaveContexts(TheCustomHeapType * tlab);
+
 #if defined(USE_THREAD_KEYWORD)
 
 // Thread-specific buffers and pointers to hold the TLAB.
@@ -70,16 +125,71 @@ extern Hoard::HoardHeapType * getMainHoardHeap();
 // use of Hoard in a dlopen module, but is MUCH faster.
 
 #define INITIAL_EXEC_ATTR __attribute__((tls_model ("initial-exec")))
+#if !HOARD_TLAB_DONATION
 #define BUFFER_SIZE (sizeof(TheCustomHeapType) / sizeof(double) + 1)
 
 static __thread double tlabBuffer[BUFFER_SIZE] INITIAL_EXEC_ATTR;
+#endif
 static __thread TheCustomHeapType * theTLAB INITIAL_EXEC_ATTR = NULL;
 
+// The key's destructor runs however the thread exits (cancellation
+// included), and takes its TLAB out of the table before the thread's
+// storage goes away.
+
+static pthread_key_t theTLABKey;
+static pthread_once_t tlabKeyOnce = PTHREAD_ONCE_INIT;
+
+static void forgetThatHeap(void * p) {
+  TheCustomHeapType * heap = reinterpret_cast<TheCustomHeapType *>(p);
+  if (theTLAB != NULL) {
+    theTLAB = hoardLeaveContexts(theTLAB);
+  }
+#if HOARD_TLAB_DONATION
+  // Hand the TLAB, full, to the next thread to start, then relinquish
+  // the assigned heap.
+  int heapIndex = heap->takeHeapIndex();
+  unregisterTLAB(heap);
+  theTLAB = NULL;
+  Hoard::retireTLAB(heap);
+  getMainHoardHeap()->releaseHeap(heapIndex);
+#else
+  heap->clear();
+  unregisterTLAB(heap);
+#endif
+}
+
+static void makeTLABKey() {
+  pthread_key_create(&theTLABKey, forgetThatHeap);
+}
+
 // Initialize the TLAB (must only be called once).
 
 static TheCustomHeapType * initializeCustomHeap() {
+#if HOARD_TLAB_DONATION
+  // The TLAB has to outlive us (see forgetThatHeap).
+  theTLAB = Hoard::newTLAB();
+#else
   new (reinterpret_cast<char *>(&tlabBuffer)) TheCustomHeapType(getMainHoardHeap());
-  return (theTLAB = reinterpret_cast<TheCustomHeapType *>(&tlabBuffer));
+  theTLAB = reinterpret_cast<TheCustomHeapType *>(&tlabBuffer);
+#endif
+  pthread_once(&tlabKeyOnce, makeTLABKey);
+  pthread_setspecific(theTLABKey, theTLAB);
+  registerTLAB(theTLAB);
+  return theTLAB;
+}
+
+// The TLAB, if this thread has one yet.
+
+static TheCustomHeapType * currentTLAB() {
+  return theTLAB;
+}
+
+// Go back to this thread's own TLAB, out of any contexts.
+
+static void leaveContexts() {
+  if (theTLAB != NULL) {
+    theTLAB = hoardLeaveContexts(theTLAB);
+  }
 }
 
 // Get the TLAB.
@@ -90,6 +200,15 @@ TheCustomHeapType * getCustomHeap() {
   return theTLAB;
 }
 
+// Serve this thread from another TLAB (see hoard_context_enter). The
+// key keeps the thread's own, which is the one flushed at exit.
+
+TheCustomHeapType * swapCustomHeap(TheCustomHeapType * heap) {
+  TheCustomHeapType * previous = getCustomHeap();
+  theTLAB = heap;
+  return previous;
+}
+
 
 #else // !defined(USE_THREAD_KEYWORD)
 
@@ -101,12 +220,21 @@ static pthread_once_t key_once = PTHREAD_ONCE_INIT;
 // TLAB and then reclaims the memory allocated to hold it.
 
 static void deleteThatHeap(void * p) {
-  TheCustomHeapType * heap = reinterpret_cast<TheCustomHeapType *>(p);
+  // The key holds the TLAB we were last served from, which belongs to
+  // a context if we exited inside one.
+  TheCustomHeapType * heap = hoardLeaveContexts(reinterpret_cast<TheCustomHeapType *>(p));
+  int heapIndex = heap->takeHeapIndex();
+  unregisterTLAB(heap);
+#if HOARD_TLAB_DONATION
+  // Hand the TLAB, full, to the next thread to start.
+  Hoard::retireTLAB(heap);
+#else
   heap->clear();
   getMainHoardHeap()->free(reinterpret_cast<void *>(heap));
+#endif
 
   // Relinquish the assigned heap.
-  getMainHoardHeap()->releaseHeap();
+  getMainHoardHeap()->releaseHeap(heapIndex);
 }
 
 static void make_heap_key() {
@@ -130,14 +258,34 @@ static TheCustomHeapType * initializeCustomHeap() {
   assert(pthread_getspecific(theHeapKey) == NULL);
   // Allocate a per-thread heap.
   TheCustomHeapType * heap;
+#if HOARD_TLAB_DONATION
+  heap = Hoard::newTLAB();
+#else
   size_t sz = sizeof(TheCustomHeapType) + sizeof(double);
   char * mh = reinterpret_cast<char *>(getMainHoardHeap()->malloc(sz));
   heap = new (mh) TheCustomHeapType(getMainHoardHeap());
+#endif
   // Store it in the appropriate thread-local area.
   pthread_setspecific(theHeapKey, reinterpret_cast<void *>(heap));
+  registerTLAB(heap);
   return heap;
 }
 
+static TheCustomHeapType * currentTLAB() {
+  initTSD();
+  return reinterpret_cast<TheCustomHeapType *>(pthread_getspecific(theHeapKey));
+}
+
+static void leaveContexts() {
+  TheCustomHeapType * heap = currentTLAB();
+  if (heap != NULL) {
+    TheCustomHeapType * own = hoardLeaveContexts(heap);
+    if (own != heap) {
+      pthread_setspecific(theHeapKey, reinterpret_cast<void *>(own));
+    }
+  }
+}
+
 TheCustomHeapType * getCustomHeap() {
   TheCustomHeapType * heap;
   initTSD();
@@ -148,6 +296,14 @@ TheCustomHeapType * getCustomHeap() {
   return heap;
 }
 
+// Serve this thread from another TLAB (see hoard_context_enter).
+
+TheCustomHeapType * swapCustomHeap(TheCustomHeapType * heap) {
+  TheCustomHeapType * previous = getCustomHeap();
+  pthread_setspecific(theHeapKey, reinterpret_cast<void *>(heap));
+  return previous;
+}
+
 #endif
 
 
@@ -172,19 +328,31 @@ extern "C" {
 
 // A special routine we call on thread exit to free up some resources.
 static void exitRoutine() {
+  leaveContexts();
+#if HOARD_TLAB_DONATION
+  // Nothing more to do yet: once this thread is gone, its TLAB goes,
+  // full, to another thread, and only then do we relinquish the heap
+  // (see forgetThatHeap).
+#else
   TheCustomHeapType * heap = getCustomHeap();
 
   // Clear the TLAB's buffer.
   heap->clear();
 
   // Relinquish the assigned heap.
-  getMainHoardHeap()->releaseHeap();
+  getMainHoardHeap()->releaseHeap(heap->takeHeapIndex());
+#endif
 }
 
 extern "C" {
   static inline void * startMeUp(void * a) {
-    getCustomHeap();
-    getMainHoardHeap()->findUnusedHeap();
+    getCustomHeap()->setHeapIndex((int) getMainHoardHeap()->findUnusedHeap());
+#if HOARD_MAINTENANCE_INTERVAL
+    // Programs that never create a thread keep running without a
+    // maintenance thread; the first one created starts it, here
+    // rather than inside pthread_create, which starting it calls.
+    hoardStartMaintenance();
+#endif
     pair<threadFunctionType, void *> * z
       = (pair<threadFunctionType, void *> *) a;
 
@@ -200,6 +368,71 @@ extern "C" {
 
 extern volatile bool anyThreadCreated;
 
+// Called before creating a thread. The first time, this ends
+// sequential mode: the TLAB holds more while we are alone (see
+// tlab.h), so flush it before anyone else can allocate.
+
+static void endSequentialMode() {
+  if (!anyThreadCreated) {
+    getCustomHeap()->clear();
+    anyThreadCreated = true;
+  }
+}
+
+//
+// Make fork() safe: hold every allocator lock across it, so that the
+// child never sees an operation half-done by another thread.
+//
+
+extern "C" {
+  void xxmalloc_lock();
+  void xxmalloc_unlock();
+}
+
+extern void hoardAfterForkChild (int privateHeap);
+
+static void prepareFork() {
+  tlabTableLock().lock();
+  xxmalloc_lock();
+}
+
+static void parentAfterFork() {
+  xxmalloc_unlock();
+  tlabTableLock().unlock();
+}
+
+static void childAfterFork() {
+  TheCustomHeapType * mine = currentTLAB();
+  // Inside allocation contexts, our own TLAB is the outermost.
+  while ((mine != NULL) && (mine->getOuter() != NULL)) {
+    mine = mine->getOuter();
+  }
+  hoardAfterForkChild (mine ? mine->getPrivateHeapIndex() : 0);
+  tlabTableLock().unlock();
+
+#if !HOARD_NO_LOCK_OPT
+  // The child has exactly one thread again.
+  anyThreadCreated = false;
+#endif
+
+  // Abandon the other threads' TLABs, and whatever they held. A
+  // thread that did not survive may have been halfway through
+  // changing its TLAB, which it does without a lock, so neither its
+  // free lists nor the TLAB itself can be trusted: walking them could
+  // free an object twice, or something that was never free.
+  for (int i = 0; i < Hoard::MaxThreads; i++) {
+    if (allTLABs[i] != mine) {
+      allTLABs[i] = NULL;
+    }
+  }
+}
+
+static void registerForkHandlers() __attribute__((constructor));
+
+static void registerForkHandlers() {
+  pthread_atfork(prepareFork, parentAfterFork, childAfterFork);
+}
+
 
 // Intercept thread creation. We need this to first associate
 // a heap with the thread and instantiate the thread-specific heap
@@ -241,7 +474,7 @@ extern "C" int thr_create (void * stack_base,
   static thr_create_function real_thr_create =
     (thr_create_function) dlsym (RTLD_NEXT, fname);
 
-  anyThreadCreated = true;
+  endSequentialMode();
 
   typedef pair<threadFunctionType, void *> argsType;
   argsType * args =
@@ -330,7 +563,7 @@ extern "C" int pthread_create (pthread_t *thread,
     reinterpret_cast<pthread_create_function>
     (reinterpret_cast<intptr_t>(dlsym(RTLD_NEXT, fname)));
 
-  anyThreadCreated = true;
+  endSequentialMode();
 
   pair<threadFunctionType, void *> * args =
     // new (_heap.malloc(sizeof(pair<threadFunctionType, void*>)))
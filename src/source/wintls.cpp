@@ -52,12 +52,20 @@ __declspec(thread) TheCustomHeapType * threadLocalHeap = NULL;
 
 extern HoardHeapType * getMainHoardHeap (void);
 
+// A thread that exits inside allocation contexts leaves them first
+// (see libhoard.cpp), so that its own TLAB is the one torn down.
+extern TheCustomHeapType * hoardLeaveContexts (TheCustomHeapType * tlab);
+
 static TheCustomHeapType * initializeCustomHeap (void)
 {
   // Allocate a per-thread heap.
   TheCustomHeapType * heap;
+#if HOARD_TLAB_DONATION
+  heap = newTLAB();
+#else
   void * mh = getMainHoardHeap()->malloc(sizeof(TheCustomHeapType));
   heap = new (mh) TheCustomHeapType (getMainHoardHeap());
+#endif
 
   // Store it in the appropriate thread-local area.
   threadLocalHeap = heap;
@@ -72,6 +80,14 @@ TheCustomHeapType * getCustomHeap() {
   initializeCustomHeap();
   return threadLocalHeap;
 }
+
+// Serve this thread from another TLAB (see hoard_context_enter).
+
+TheCustomHeapType * swapCustomHeap (TheCustomHeapType * heap) {
+  TheCustomHeapType * previous = getCustomHeap();
+  threadLocalHeap = heap;
+  return previous;
+}
 #if 0
 {
   TheCustomHeapType * heap;
@@ -116,24 +132,42 @@ extern "C" {
 	// heap 0.
 	getMainHoardHeap()->chooseZero();
       } else {
-	getMainHoardHeap()->findUnusedHeap();
+	getCustomHeap()->setHeapIndex ((int) getMainHoardHeap()->findUnusedHeap());
       }
       getCustomHeap();
       break;
       
     case DLL_THREAD_DETACH:
       {
-	// Dump the memory from the TLAB.
-	getCustomHeap()->clear();
-	
 	TheCustomHeapType *heap
 	  = threadLocalHeap;
 	//	  = (TheCustomHeapType *) TlsGetValue(LocalTLABIndex);
+
+	if (heap == NULL) {
+	  // Our TLAB has already gone (say, donated): there is nothing
+	  // to dump and no heap index to hand back.
+	  break;
+	}
+	heap = hoardLeaveContexts (heap);
+	threadLocalHeap = heap;
+
+#if !HOARD_TLAB_DONATION
+	// Dump the memory from the TLAB.
+	heap->clear();
+#endif
+	
+	int heapIndex = heap->takeHeapIndex();
+	
+#if HOARD_TLAB_DONATION
+	// Hand the TLAB, full, to the next thread to start.
+	threadLocalHeap = NULL;
+	retireTLAB (heap);
+#endif
 	
 	if (np != 1) {
 	  // If we're on a multiprocessor box, relinquish the heap
 	  // assigned to this thread.
-	  getMainHoardHeap()->releaseHeap();
+	  getMainHoardHeap()->releaseHeap (heapIndex);
 	}
 	
 	if (heap != 0) {
@@ -0,0 +1,60 @@
+// Checks that a thread that exits with an arena pushed (see
+// hoard_arena_push) does not hand that arena on, with its TLAB under
+// donation, to the next thread. Link against libhoard, and build it
+// with HOARD_TLAB_DONATION=1 to cover donation too. Exits with 0 if
+// all is well.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hoard.h"
+
+static int failures = 0;
+
+static void fail (const char * what) {
+  printf ("FAILED: %s\n", what);
+  failures++;
+}
+
+static bool sameSuperblock (void * a, void * b) {
+  // Superblocks are at least 64K, and aligned.
+  return ((size_t) a >> 16) == ((size_t) b >> 16);
+}
+
+static hoard_arena * theArena;
+static void * arenaObject;
+static void * plainObject;
+
+static void * pushAndExit (void *) {
+  hoard_arena_push (theArena);
+  arenaObject = malloc (32);
+  return NULL;
+}
+
+static void * allocatePlain (void *) {
+  plainObject = malloc (32);
+  return NULL;
+}
+
+static void testArenaExit (void) {
+  theArena = hoard_arena_create();
+  pthread_t t;
+  pthread_create (&t, NULL, pushAndExit, NULL);
+  pthread_join (t, NULL);
+  pthread_create (&t, NULL, allocatePlain, NULL);
+  pthread_join (t, NULL);
+  if (sameSuperblock (arenaObject, plainObject)) {
+    fail ("a new thread allocated from an exited thread's arena");
+  }
+  free (plainObject);
+  hoard_arena_destroy (theArena);
+}
+
+int main (void) {
+  testArenaExit();
+  if (failures == 0) {
+    printf ("ok\n");
+  }
+  return failures ? 1 : 0;
+}
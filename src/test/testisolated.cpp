@@ -0,0 +1,54 @@
+// Checks hoard_malloc_isolated (see hoard.h): isolated objects, large
+// ones included, must be cache-line aligned, round-trip through free
+// and report their size, however they are freed. Link against
+// libhoard. Exits with 0 if all is well.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __APPLE__
+#include <malloc.h>
+#endif
+
+#include "hoard.h"
+
+static int failures = 0;
+
+static void fail (const char * what) {
+  printf ("FAILED: %s\n", what);
+  failures++;
+}
+
+static void testIsolated (void) {
+  static const size_t sizes[] = { 1, 64, 100, 1000, 1024, 1025, 4000, 70000, 300000, 3000000 };
+  for (int r = 0; r < 50; r++) {
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      char * p = (char *) hoard_malloc_isolated (sizes[i]);
+      if ((p == NULL) || ((size_t) p % 64 != 0)) {
+	fail ("isolated object not cache-line aligned");
+	return;
+      }
+#ifndef __APPLE__
+      if (malloc_usable_size (p) < sizes[i]) {
+	fail ("isolated object smaller than asked for");
+	return;
+      }
+#endif
+      memset (p, 1, sizes[i]);
+      if (r & 1) {
+	free (p);
+      } else {
+	hoard_free_no_tcache (p);
+      }
+    }
+  }
+}
+
+int main (void) {
+  testIsolated();
+  if (failures == 0) {
+    printf ("ok\n");
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,82 @@
+// Checks that hoard_watch_memory_pressure reads made-up cgroup files:
+// as memory.current passes 80% and then 90% of memory.max, the
+// pressure that hoard_get_stats reports goes from none to high to
+// critical. Link against libhoard (Linux only). Exits with 0 if all
+// is well.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hoard.h"
+
+static int failures = 0;
+
+static void fail (const char * what) {
+  printf ("FAILED: %s\n", what);
+  failures++;
+}
+
+static char dir[] = "/tmp/hoardpressureXXXXXX";
+
+static void writeFile (const char * name, const char * contents) {
+  char path[256];
+  snprintf (path, sizeof(path), "%s/%s", dir, name);
+  FILE * f = fopen (path, "w");
+  if (f == NULL) {
+    fail ("cannot write the cgroup files");
+    return;
+  }
+  fputs (contents, f);
+  fclose (f);
+}
+
+static void removeFile (const char * name) {
+  char path[256];
+  snprintf (path, sizeof(path), "%s/%s", dir, name);
+  unlink (path);
+}
+
+static void expectPressure (const char * current, int level, const char * what) {
+  writeFile ("memory.current", current);
+  hoard_stats stats;
+  hoard_get_stats (&stats);
+  if (stats.memory_pressure != level) {
+    fail (what);
+  }
+}
+
+static void testMemoryPressure (void) {
+  if (mkdtemp (dir) == NULL) {
+    fail ("cannot make a directory for the cgroup files");
+    return;
+  }
+  writeFile ("memory.max", "1000000\n");
+  writeFile ("memory.current", "500000\n");
+  writeFile ("memory.pressure",
+	     "some avg10=0.00 avg60=0.00 avg300=0.00 total=0\n"
+	     "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+  // With no maintenance thread, hoard_get_stats samples the pressure
+  // itself.
+  hoard_maintenance_stop();
+  if (hoard_watch_memory_pressure (dir) != 0) {
+    fail ("nothing to watch");
+  } else {
+    expectPressure ("500000\n", 0, "pressure at 50% of the limit");
+    expectPressure ("850000\n", 1, "pressure at 85% of the limit");
+    expectPressure ("950000\n", 2, "pressure at 95% of the limit");
+  }
+  removeFile ("memory.max");
+  removeFile ("memory.current");
+  removeFile ("memory.pressure");
+  rmdir (dir);
+}
+
+int main (void) {
+  testMemoryPressure();
+  if (failures == 0) {
+    printf ("ok\n");
+  }
+  return failures ? 1 : 0;
+}
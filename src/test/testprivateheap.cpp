@@ -0,0 +1,65 @@
+// Checks that a thread with a private heap (see hoard_private_heap)
+// that exits inside an allocation context gives both back: the next
+// thread must not get the context's cached objects, and later threads
+// must still find private heaps (there are fewer than we take). Link
+// against libhoard, and build it with HOARD_TLAB_DONATION=1 to cover
+// donation too. Exits with 0 if all is well.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hoard.h"
+
+static int failures = 0;
+
+static void fail (const char * what) {
+  printf ("FAILED: %s\n", what);
+  failures++;
+}
+
+static hoard_context * theContext;
+static void * cachedObject;
+
+static void * exitInside (void * exitExplicitly) {
+  if (hoard_private_heap() < 0) {
+    fail ("no private heap");
+    return NULL;
+  }
+  hoard_context_enter (theContext);
+  cachedObject = malloc (48);
+  free (cachedObject);
+  if (exitExplicitly) {
+    pthread_exit (NULL);
+  }
+  return NULL;
+}
+
+static void * reuseCached (void *) {
+  void * p = malloc (48);
+  if (p == cachedObject) {
+    fail ("an exited thread's context object went to another thread");
+  }
+  free (p);
+  return NULL;
+}
+
+static void testPrivateHeapExit (void) {
+  for (int r = 0; (r < 300) && (failures == 0); r++) {
+    pthread_t t;
+    theContext = hoard_context_create (0);
+    pthread_create (&t, NULL, exitInside, (void *) (size_t) (r & 1));
+    pthread_join (t, NULL);
+    pthread_create (&t, NULL, reuseCached, NULL);
+    pthread_join (t, NULL);
+    hoard_context_destroy (theContext);
+  }
+}
+
+int main (void) {
+  testPrivateHeapExit();
+  if (failures == 0) {
+    printf ("ok\n");
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,284 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+
+  Copyright (c) 1998-2012 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/**
+ * @file   mksizeclasses.cpp
+ * @brief  Generates small-object size classes for a recorded workload.
+ *
+ * Reads a histogram of request sizes, one "size [count]" pair per
+ * line (a trace of sizes, one per line, works as is), and writes a
+ * profiledsizeclasses.h to standard output whose classes minimize the
+ * internal fragmentation of that histogram. Build Hoard with
+ * HOARD_PROFILED_SIZE_CLASSES to use it. The fragmentation under the
+ * classes Hoard is built with now, and under the generated ones, goes
+ * to standard error.
+ *
+ *   % make mksizeclasses
+ *   % ./mksizeclasses -n 32 histogram.txt > include/hoard/profiledsizeclasses.h
+ *   % make linux-gcc-x86-64 CPPFLAGS="-O3 -DHOARD_PROFILED_SIZE_CLASSES=1"
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "hoardheap.h"
+#include "sizeclasses.h"
+
+using namespace Hoard;
+
+typedef SizeClasses<SmallSuperblockType::Header, SUPERBLOCK_SIZE> CurrentSizeClasses;
+
+enum { Alignment = SmallSuperblockType::Header::Alignment };
+
+/// The most classes we generate (class numbers must fit a byte).
+enum { MaxClasses = 255 };
+
+/// @brief Read the histogram into counts, indexed by request size.
+/// @return false if the file cannot be read.
+static bool readHistogram (const char * name,
+			   size_t maxSize,
+			   std::vector<double>& counts,
+			   double& ignored)
+{
+  FILE * f = (strcmp (name, "-") == 0) ? stdin : fopen (name, "r");
+  if (!f) {
+    return false;
+  }
+  counts.assign (maxSize + 1, 0.0);
+  ignored = 0.0;
+  char line[256];
+  while (fgets (line, sizeof(line), f)) {
+    unsigned long sz;
+    double count = 1.0;
+    if ((line[0] == '#') || (sscanf (line, "%lu %lf", &sz, &count) < 1)) {
+      continue;
+    }
+    if (sz <= maxSize) {
+      counts[sz] += count;
+    } else {
+      ignored += count;
+    }
+  }
+  if (f != stdin) {
+    fclose (f);
+  }
+  return true;
+}
+
+/// @brief Choose numClasses class sizes, each a multiple of Alignment
+/// and the last one bigObject, that minimize the bytes lost to
+/// rounding up the requests in counts.
+static std::vector<size_t> chooseClasses (const std::vector<double>& counts,
+					  size_t bigObject,
+					  int numClasses)
+{
+  // Group requests into cells of Alignment bytes: every request in
+  // cell j, (j-1)*Alignment < sz <= j*Alignment, rounds up alike.
+  const int cells = (int) (bigObject / Alignment);
+  std::vector<double> weight (cells + 1, 0.0);
+  double total = 0.0;
+  for (size_t sz = 0; sz < counts.size(); sz++) {
+    const int cell = (sz == 0) ? 1 : (int) ((sz + Alignment - 1) / Alignment);
+    weight[cell] += counts[sz];
+    total += counts[sz];
+  }
+  // Give every cell a trace of weight, so that any classes the
+  // histogram does not need still cover unseen sizes sensibly.
+  for (int j = 1; j <= cells; j++) {
+    weight[j] += (total + 1.0) / (1e6 * cells);
+  }
+  std::vector<double> prefix (cells + 1, 0.0);
+  for (int j = 1; j <= cells; j++) {
+    prefix[j] = prefix[j-1] + weight[j];
+  }
+  if (numClasses > cells) {
+    numClasses = cells;
+  }
+
+  // best[k][j]: the least cost of covering cells 1..j with k classes,
+  // the largest of which is j; from[k][j] is the previous class.
+  const double infinity = 1e300;
+  std::vector<std::vector<double> > best (numClasses + 1, std::vector<double> (cells + 1, infinity));
+  std::vector<std::vector<int> > from (numClasses + 1, std::vector<int> (cells + 1, 0));
+  best[0][0] = 0.0;
+  for (int k = 1; k <= numClasses; k++) {
+    for (int j = k; j <= cells; j++) {
+      for (int i = k - 1; i < j; i++) {
+	if (best[k-1][i] >= infinity) {
+	  continue;
+	}
+	// Everything in cells i+1..j rounds up to j*Alignment.
+	const double c = best[k-1][i] + (double) j * Alignment * (prefix[j] - prefix[i]);
+	if (c < best[k][j]) {
+	  best[k][j] = c;
+	  from[k][j] = i;
+	}
+      }
+    }
+  }
+  std::vector<size_t> classes (numClasses);
+  int j = cells;
+  for (int k = numClasses; k >= 1; k--) {
+    classes[k-1] = (size_t) j * Alignment;
+    j = from[k][j];
+  }
+  return classes;
+}
+
+/// The fraction of requested bytes lost to rounding up, for requests up to maxSize.
+template <class Classes>
+static double fragmentation (const std::vector<double>& counts,
+			     size_t maxSize,
+			     const Classes& classes)
+{
+  double requested = 0.0, wasted = 0.0;
+  for (size_t sz = 1; (sz <= maxSize) && (sz < counts.size()); sz++) {
+    if (counts[sz] > 0.0) {
+      requested += counts[sz] * sz;
+      wasted += counts[sz] * (classes.roundUp (sz) - sz);
+    }
+  }
+  return (requested > 0.0) ? (100.0 * wasted / requested) : 0.0;
+}
+
+/// Rounds sizes as the classes Hoard is built with now.
+class Current {
+public:
+  size_t roundUp (size_t sz) const {
+    if (sz < Alignment) {
+      sz = Alignment;
+    }
+    return CurrentSizeClasses::getClassSize (CurrentSizeClasses::getSizeClass (sz));
+  }
+};
+
+/// Rounds sizes as the generated classes.
+class Generated {
+public:
+  Generated (const std::vector<size_t>& classes)
+    : _classes (classes)
+  {}
+  size_t roundUp (size_t sz) const {
+    size_t i = 0;
+    while (_classes[i] < sz) {
+      i++;
+    }
+    return _classes[i];
+  }
+private:
+  const std::vector<size_t>& _classes;
+};
+
+static void writeHeader (const char * source,
+			 const std::vector<size_t>& classes,
+			 size_t bigObject)
+{
+  const int n = (int) classes.size();
+  printf ("// -*- C++ -*-\n\n");
+  printf ("// Generated by mksizeclasses from %s: do not edit.\n\n", source);
+  printf ("#ifndef HOARD_PROFILEDSIZECLASSES_H\n");
+  printf ("#define HOARD_PROFILEDSIZECLASSES_H\n\n");
+  printf ("#include <cstddef>\n\n");
+  printf ("namespace Hoard {\n\n");
+  printf ("  class ProfiledSizeClasses {\n");
+  printf ("  public:\n\n");
+  printf ("    enum { NUM_BINS = %d };\n\n", n);
+  printf ("    enum { BIG_OBJECT = %lu };\n\n", (unsigned long) bigObject);
+  printf ("    static inline unsigned int getSizeClass (size_t sz) {\n");
+  printf ("      static const unsigned char sizeClass[] = {");
+  int c = 0;
+  for (size_t cell = 0; cell <= bigObject / Alignment; cell++) {
+    while (classes[c] < cell * Alignment) {
+      c++;
+    }
+    printf ("%s%d", (cell % 16) ? ", " : (cell ? ",\n\t" : "\n\t"), c);
+  }
+  printf (" };\n");
+  printf ("      return sizeClass[(sz + %d) / %d];\n", Alignment - 1, Alignment);
+  printf ("    }\n\n");
+  printf ("    static inline size_t getClassSize (const unsigned int i) {\n");
+  printf ("      static const size_t classSize[] = {");
+  for (int i = 0; i < n; i++) {
+    printf ("%s%lu", (i % 8) ? ", " : (i ? ",\n\t" : "\n\t"), (unsigned long) classes[i]);
+  }
+  printf (" };\n");
+  printf ("      return classSize[i];\n");
+  printf ("    }\n\n");
+  printf ("  };\n\n");
+  printf ("}\n\n");
+  printf ("#endif\n");
+}
+
+int main (int argc, char * argv[])
+{
+  int numClasses = CurrentSizeClasses::NUM_BINS;
+  size_t bigObject = CurrentSizeClasses::BIG_OBJECT;
+  int i = 1;
+  for (; (i < argc - 1) && (argv[i][0] == '-'); i += 2) {
+    if (strcmp (argv[i], "-n") == 0) {
+      numClasses = atoi (argv[i+1]);
+    } else if (strcmp (argv[i], "-b") == 0) {
+      bigObject = (size_t) atol (argv[i+1]);
+    } else {
+      break;
+    }
+  }
+  if ((i != argc - 1) || (numClasses < 1) || (numClasses > MaxClasses)
+      || (bigObject < Alignment) || (bigObject % Alignment != 0)) {
+    fprintf (stderr, "Usage: %s [-n classes] [-b largest-small-object] histogram\n", argv[0]);
+    fprintf (stderr, "  classes: 1 to %d (default %d)\n", (int) MaxClasses, (int) CurrentSizeClasses::NUM_BINS);
+    fprintf (stderr, "  largest-small-object: a multiple of %d (default %d)\n", (int) Alignment, (int) CurrentSizeClasses::BIG_OBJECT);
+    return 1;
+  }
+
+  std::vector<double> counts;
+  double ignored;
+  if (!readHistogram (argv[i], bigObject, counts, ignored)) {
+    perror (argv[i]);
+    return 1;
+  }
+
+  const std::vector<size_t> classes = chooseClasses (counts, bigObject, numClasses);
+  writeHeader (argv[i], classes, bigObject);
+
+  // Both class sets only cover requests up to their own largest class.
+  size_t covered = CurrentSizeClasses::BIG_OBJECT;
+  if (covered > bigObject) {
+    covered = bigObject;
+  }
+  fprintf (stderr, "Internal fragmentation of requests up to %lu bytes:\n", (unsigned long) covered);
+  fprintf (stderr, "  current   (%3d classes): %5.1f%%\n",
+	   (int) CurrentSizeClasses::NUM_BINS, fragmentation (counts, covered, Current()));
+  fprintf (stderr, "  generated (%3d classes): %5.1f%%\n",
+	   (int) classes.size(), fragmentation (counts, covered, Generated (classes)));
+  if (ignored > 0.0) {
+    fprintf (stderr, "(%.0f larger requests go to the large-object heap.)\n", ignored);
+  }
+  return 0;
+}